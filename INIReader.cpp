@@ -3,7 +3,7 @@
 #include <algorithm>
 #include <cctype>
 #include <cstdlib>
-#include "ini.c"
+#include "ini.h"
 #include "INIReader.h"
 
 using std::string;
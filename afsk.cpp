@@ -0,0 +1,154 @@
+// Bell 202 AFSK modulator and PCM output, the transmit half of a soft TNC.
+
+#include <cmath>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ax25.h"
+#include "hdlc.h"
+#include "afsk.h"
+
+typedef float afsk_floats __attribute__((vector_size(AFSK_VECTOR * sizeof(float))));
+typedef short afsk_shorts __attribute__((vector_size(AFSK_VECTOR * sizeof(short))));
+
+bool afsk_init(afsk_modulator& mod, int sample_rate, int volume) {
+	if (sample_rate < AFSK_SPACE * 2 || sample_rate > AFSK_MAX_RATE) return false;	// need two samples a cycle of the high tone
+	mod.sample_rate = sample_rate;
+	mod.amplitude = 32767.0f * volume / 100;
+	mod.phase = 0;
+	mod.clock = 0;
+	int tones[2] = {AFSK_SPACE, AFSK_MARK};
+	for (int t=0;t<2;t++) {
+		mod.step[t] = (unsigned int)llround(4294967296.0 * tones[t] / sample_rate);
+		for (int i=0;i<AFSK_BIT_SAMPLES;i++) {
+			double w = 2 * M_PI * tones[t] * i / sample_rate;
+			mod.rot_cos[t][i] = cos(w);
+			mod.rot_sin[t][i] = sin(w);
+		}
+	}
+	for (int i=0;i<=AFSK_TABLE+AFSK_TABLE/4;i++) mod.sine[i] = sin(2 * M_PI * i / AFSK_TABLE);
+	return true;
+}	// END OF 'afsk_init'
+
+int afsk_max_samples(const afsk_modulator& mod, int bits) {
+	return (long long)bits * mod.sample_rate / AFSK_BAUD + 1 + AFSK_VECTOR;	// the last vector may run past the end
+}	// END OF 'afsk_max_samples'
+
+int afsk_modulate(afsk_modulator& mod, const unsigned char* tones, int count, short* out) {
+	short* p = out;
+	for (int b=0;b<count;b++) {
+		int t = tones[b];
+		int n = (mod.clock + mod.sample_rate) / AFSK_BAUD - mod.clock / AFSK_BAUD;	// samples in this bit
+		mod.clock += mod.sample_rate;
+		unsigned int index = ((mod.phase >> (31 - AFSK_TABLE_BITS)) + 1) >> 1;	// nearest entry, may be AFSK_TABLE
+		float s = mod.sine[index] * mod.amplitude;				// where this bit starts
+		float c = mod.sine[index + AFSK_TABLE / 4] * mod.amplitude;
+		for (int i=0;i<n;i+=AFSK_VECTOR) {
+			afsk_floats rc, rs;
+			memcpy(&rc, &mod.rot_cos[t][i], sizeof(rc));
+			memcpy(&rs, &mod.rot_sin[t][i], sizeof(rs));
+			afsk_shorts v = __builtin_convertvector(s * rc + c * rs, afsk_shorts);	// sin(p + i * w)
+			memcpy(p + i, &v, sizeof(v));
+		}
+		mod.phase += mod.step[t] * n;
+		p += n;
+	}
+	return p - out;
+}	// END OF 'afsk_modulate'
+
+static void put_le(unsigned char* out, unsigned int value, int bytes) {	// little endian, as WAV wants
+	for (int i=0;i<bytes;i++) out[i] = value >> (8 * i);
+}
+
+static bool write_all(int fd, const void* data, long long len) {
+	const char* p = (const char*)data;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static void wav_header(unsigned char* h, int sample_rate, long long bytes) {	// 44 byte header for 16 bit mono
+	if (bytes > 0x7FFFFFF0LL) bytes = 0x7FFFFFF0LL;			// as far as the format goes
+	memcpy(h, "RIFF", 4);
+	put_le(h + 4, 36 + bytes, 4);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put_le(h + 16, 16, 4);									// fmt chunk size
+	put_le(h + 20, 1, 2);									// PCM
+	put_le(h + 22, 1, 2);									// mono
+	put_le(h + 24, sample_rate, 4);
+	put_le(h + 28, sample_rate * 2, 4);						// bytes per second
+	put_le(h + 32, 2, 2);									// bytes per sample
+	put_le(h + 34, 16, 2);									// bits per sample
+	memcpy(h + 36, "data", 4);
+	put_le(h + 40, bytes, 4);
+}
+
+bool pcm_open(pcm_output& out, const char* path, int sample_rate) {
+	out.sample_rate = sample_rate;
+	out.bytes = 0;
+	out.wav = strcmp(path, "-") != 0;
+	if (!out.wav) {											// keep stdout for samples, and send our messages to stderr instead
+		out.fd = dup(STDOUT_FILENO);
+		return out.fd != -1 && dup2(STDERR_FILENO, STDOUT_FILENO) != -1;
+	}
+	out.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out.fd == -1) return false;
+	unsigned char header[44];
+	wav_header(header, sample_rate, 0);						// sizes are filled in by pcm_close()
+	return write_all(out.fd, header, sizeof(header));
+}	// END OF 'pcm_open'
+
+bool pcm_write(pcm_output& out, const short* samples, int count) {
+	out.bytes += count * 2;
+	return write_all(out.fd, samples, count * 2LL);		// native byte order, little endian where this runs
+}	// END OF 'pcm_write'
+
+void pcm_close(pcm_output& out) {
+	if (out.fd == -1) return;
+	if (out.wav) {
+		unsigned char header[44];
+		wav_header(header, out.sample_rate, out.bytes);
+		pwrite(out.fd, header, sizeof(header), 0);			// if this fails the data is still there, just unlabelled
+	}
+	close(out.fd);
+	out.fd = -1;
+}	// END OF 'pcm_close'
+
+#define AFSK_TAIL_FLAGS 3		// after the last frame, so the receiver sees it end before the carrier drops
+
+bool afsk_tx_init(afsk_tx& tx, const char* path, int sample_rate, int volume, int txdelay_ms) {
+	if (!afsk_init(tx.mod, sample_rate, volume)) {
+		errno = EINVAL;
+		return false;
+	}
+	if (!pcm_open(tx.out, path, sample_rate)) return false;
+	tx.tone = 1;
+	tx.txdelay_flags = txdelay_ms * AFSK_BAUD / 8 / 1000;
+	if (tx.txdelay_flags < 1) tx.txdelay_flags = 1;
+	int max_bits = HDLC_MAX_BITS(AX25_MAX_HEADER + AX25_MAX_INFO, tx.txdelay_flags + AFSK_TAIL_FLAGS);
+	tx.bits = new unsigned char[max_bits];
+	tx.samples = new short[afsk_max_samples(tx.mod, max_bits)];
+	tx.frames = 0;
+	return true;
+}	// END OF 'afsk_tx_init'
+
+bool afsk_send(afsk_tx& tx, const unsigned char* const* frames, const int* lens, int count) {
+	for (int i=0;i<count;i++) {
+		if (lens[i] > AX25_MAX_HEADER + AX25_MAX_INFO) continue;
+		int before = i == 0 ? tx.txdelay_flags : 1;			// frames in a batch share a flag between them
+		int after = i == count - 1 ? AFSK_TAIL_FLAGS : 0;
+		int bits = hdlc_encode(tx.tone, tx.bits, frames[i], lens[i], before, after);
+		int samples = afsk_modulate(tx.mod, tx.bits, bits, tx.samples);
+		if (!pcm_write(tx.out, tx.samples, samples)) return false;
+		tx.frames++;
+	}
+	return true;
+}	// END OF 'afsk_send'
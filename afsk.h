@@ -0,0 +1,82 @@
+// Bell 202 AFSK modulator and PCM output, the transmit half of a soft TNC.
+
+#ifndef __AFSK_H__
+#define __AFSK_H__
+
+#define AFSK_BAUD 1200
+#define AFSK_MARK 1200			// Hz, a 1 tone
+#define AFSK_SPACE 2200			// Hz, a 0 tone
+#define AFSK_MAX_RATE 48000		// highest sample rate we render at
+#define AFSK_VECTOR 8			// samples rendered per vector operation
+#define AFSK_BIT_SAMPLES 48		// room for one bit at AFSK_MAX_RATE, a multiple of AFSK_VECTOR
+#define AFSK_TABLE_BITS 12		// sine table of 4096 entries
+#define AFSK_TABLE (1 << AFSK_TABLE_BITS)
+
+// Phase is a 32 bit accumulator (2^32 is a full cycle) that runs on across
+// bits and frames, so tone changes are continuous. Within one bit the tone
+// is fixed, so sample i of the bit is sin(p + i * w) = sin(p) cos(i * w) +
+// cos(p) sin(i * w): sin(p) and cos(p) come from the sine table once per bit
+// and the rest is a multiply-add against per-tone tables, done AFSK_VECTOR
+// samples at a time with GCC vector extensions (SSE, AVX or NEON, whatever
+// the target has).
+struct afsk_modulator {
+	int sample_rate;
+	float amplitude;			// peak, in sample units
+	unsigned int step[2];		// phase per sample, space and mark
+	unsigned int phase;
+	long long clock;			// bits so far * sample_rate, so bits keep their fractional length in samples
+	float sine[AFSK_TABLE + AFSK_TABLE / 4 + 1];	// a quarter extra so cos(p) = sine[p + 1/4], and the wrap
+	float rot_cos[2][AFSK_BIT_SAMPLES] __attribute__((aligned(32)));	// cos(i * w), per tone
+	float rot_sin[2][AFSK_BIT_SAMPLES] __attribute__((aligned(32)));
+};
+
+// Set up for 'sample_rate' (up to AFSK_MAX_RATE) at 'volume' percent of full
+// scale. Returns false if the rate is out of range.
+bool afsk_init(afsk_modulator& mod, int sample_rate, int volume);
+
+// The most samples afsk_modulate() can write for 'bits' bits, slack included.
+int afsk_max_samples(const afsk_modulator& mod, int bits);
+
+// Render 'count' tones (1 mark, 0 space, one per bit) as 16 bit samples.
+// Returns the number of samples.
+int afsk_modulate(afsk_modulator& mod, const unsigned char* tones, int count, short* out);
+
+struct pcm_output {				// where rendered audio goes
+	int fd;
+	bool wav;					// a WAV file, whose header gets the length on close
+	int sample_rate;
+	long long bytes;			// sample data written
+};
+
+// Open 'path' for 16 bit mono samples: "-" is raw PCM on stdout (for a pipe
+// to aplay and friends), after which stdout itself goes to stderr so our
+// messages stay out of the audio; anything else is a WAV file. Returns false
+// with errno set if it can't be opened.
+bool pcm_open(pcm_output& out, const char* path, int sample_rate);
+
+// Write samples, blocking until they're all out. A player on a pipe paces
+// us at its own sample rate. Returns false if the write fails.
+bool pcm_write(pcm_output& out, const short* samples, int count);
+
+void pcm_close(pcm_output& out);
+
+// A transmitter: frames go out as HDLC over AFSK, each batch keyed up with
+// 'txdelay' worth of flags first and a few after. Buffers are allocated by
+// afsk_tx_init().
+struct afsk_tx {
+	afsk_modulator mod;
+	pcm_output out;
+	unsigned char tone;			// NRZI line state
+	int txdelay_flags;
+	unsigned char* bits;
+	short* samples;
+	unsigned long frames;
+};
+
+bool afsk_tx_init(afsk_tx& tx, const char* path, int sample_rate, int volume, int txdelay_ms);
+
+// Send a batch of AX.25 frames (without FCS) as one transmission. Returns
+// false if the output failed.
+bool afsk_send(afsk_tx& tx, const unsigned char* const* frames, const int* lens, int count);
+
+#endif  // __AFSK_H__
@@ -0,0 +1,441 @@
+// APRS payload encoding and decoding.
+
+#include <algorithm>
+#include <cstring>
+#include "aprs.h"
+
+static constexpr long long BASE91_POWERS[4] = {91 * 91 * 91, 91 * 91, 91, 1};
+
+// Compressed speed is s where speed = 1.08^s - 1 knots. bound[s] is the
+// lowest speed, in hundredths of a knot, that rounds up to s + 1, which is
+// just above 1.08^(s + 0.5) - 1. Built at compile time, no libm.
+struct speed_bounds {
+	int bound[90];
+	constexpr speed_bounds() : bound() {
+		double p = 1.0392304845413263;				// 1.08^0.5
+		for (int s=0;s<90;s++) {
+			bound[s] = (int)((p - 1) * 100) + 1;
+			p *= 1.08;
+		}
+	}
+};
+static constexpr speed_bounds SPEED_BOUNDS;
+
+static long hundredths(long udeg) {			// micro-degrees to hundredths of a minute, rounded, sign dropped
+	long long value = udeg < 0 ? -(long long)udeg : udeg;
+	return (value * 6 + 500) / 1000;			// * 60 minutes * 100 / 10^6
+}
+
+static char* put_digits(char* out, long value, int digits) {	// 'digits' decimal digits, zero padded
+	for (int i=digits-1;i>=0;i--) {
+		out[i] = '0' + value % 10;
+		value /= 10;
+	}
+	return out + digits;
+}
+
+static char* put_base91(char* out, long long value) {		// 4 base91 digits
+	for (int i=0;i<4;i++) {
+		*out++ = value / BASE91_POWERS[i] + 33;
+		value %= BASE91_POWERS[i];
+	}
+	return out;
+}
+
+int aprs_position(char* out, long lat, long lon, char table, char symbol) {
+	long lat_hm = hundredths(lat);
+	long lon_hm = hundredths(lon);
+	char* p = out;
+	p = put_digits(p, lat_hm / 6000, 2);			// DDMM.hh
+	p = put_digits(p, lat_hm % 6000 / 100, 2);
+	*p++ = '.';
+	p = put_digits(p, lat_hm % 100, 2);
+	*p++ = lat < 0 ? 'S' : 'N';
+	*p++ = table;
+	p = put_digits(p, lon_hm / 6000, 3);			// DDDMM.hh
+	p = put_digits(p, lon_hm % 6000 / 100, 2);
+	*p++ = '.';
+	p = put_digits(p, lon_hm % 100, 2);
+	*p++ = lon < 0 ? 'W' : 'E';
+	*p++ = symbol;
+	return p - out;
+}	// END OF 'aprs_position'
+
+int aprs_compressed(char* out, long lat, long lon, int speed, int course, char table, char symbol) {
+	char* p = out;
+	*p++ = table;
+	p = put_base91(p, 380926LL * (90000000LL - lat) / 1000000);	// formula from aprs spec, in micro-degrees
+	p = put_base91(p, 190463LL * (180000000LL + lon) / 1000000);
+	*p++ = symbol;
+	*p++ = course % 360 / 4 + 33;
+	*p++ = std::upper_bound(SPEED_BOUNDS.bound, SPEED_BOUNDS.bound + 89, speed) - SPEED_BOUNDS.bound + 33;	// nearest s
+	*p++ = 0x5F;									// current gps fix, from RMC
+	return p - out;
+}	// END OF 'aprs_compressed'
+
+int aprs_mice(char* destination, char* info, long lat, long lon, int speed, int course, char table, char symbol, int message) {
+	bool south = lat < 0;
+	bool west = lon < 0;
+	lat = hundredths(lat);
+	lon = hundredths(lon);
+	speed = (speed + 50) / 100;					// whole knots
+
+	int lat_digits[6] = {						// DDMMhh
+		(int)(lat / 60000), (int)(lat / 6000 % 10),
+		(int)(lat % 6000 / 1000), (int)(lat % 1000 / 100),
+		(int)(lat % 100 / 10), (int)(lat % 10)};
+	int lon_deg = lon / 6000;
+	int lon_min = lon % 6000 / 100;
+	int lon_hun = lon % 100;
+	bool offset = lon_deg < 10 || lon_deg >= 100;	// longitude offset, +100 degrees
+
+	bool flags[6] = {(message & 4) != 0, (message & 2) != 0, (message & 1) != 0, !south, offset, west};
+	for (int i=0;i<6;i++) {
+		destination[i] = lat_digits[i] + (flags[i] ? 'P' : '0');	// 'P'-'Y' for a set bit, '0'-'9' otherwise
+	}
+
+	if (speed > 799) speed = 799;
+	if (course == 0 && speed > 0) course = 360;	// 0 means unknown, north is 360
+	info[0] = '`';								// current gps data
+	if (lon_deg < 10) info[1] = lon_deg + 118;
+	else if (lon_deg < 100) info[1] = lon_deg + 28;
+	else if (lon_deg < 110) info[1] = lon_deg + 8;
+	else info[1] = lon_deg - 72;
+	info[2] = lon_min < 10 ? lon_min + 88 : lon_min + 28;
+	info[3] = lon_hun + 28;
+	info[4] = speed / 10 + 28;					// SP+28
+	info[5] = speed % 10 * 10 + course / 100 + 28;	// DC+28
+	info[6] = course % 100 + 28;				// SE+28
+	info[7] = symbol;
+	info[8] = table;
+	return APRS_MICE_LEN;
+}	// END OF 'aprs_mice'
+
+// Decoding
+
+// Speed for each compressed s byte, in hundredths of a knot: 1.08^s - 1
+// knots, rounded. Built at compile time like SPEED_BOUNDS.
+struct speed_values {
+	int value[90];
+	constexpr speed_values() : value() {
+		double p = 1.0;
+		for (int s=0;s<90;s++) {
+			value[s] = (int)((p - 1) * 100 + 0.5);
+			p *= 1.08;
+		}
+	}
+};
+static constexpr speed_values SPEED_VALUES;
+
+static int number(const char* p, int n) {		// value of exactly n decimal digits, or -1
+	int value = 0;
+	for (int i=0;i<n;i++) {
+		if (p[i] < '0' || p[i] > '9') return -1;
+		value = value * 10 + p[i] - '0';
+	}
+	return value;
+}
+
+static long base91(const char* p, int n) {		// n base91 digits, or -1
+	long value = 0;
+	for (int i=0;i<n;i++) {
+		if (p[i] < 33 || p[i] > 123) return -1;
+		value = value * 91 + p[i] - 33;
+	}
+	return value;
+}
+
+static long minutes_udeg(long hm) {			// hundredths of a minute to micro-degrees, rounded
+	return (hm * 1000 + 3) / 6;
+}
+
+static aprs_text view(const char* p, const char* end) {
+	aprs_text text = {p, (int)(end - p)};
+	return text;
+}
+
+static aprs_text trimmed(const char* p, int len) {	// without trailing spaces
+	while (len > 0 && p[len-1] == ' ') len--;
+	aprs_text text = {p, len};
+	return text;
+}
+
+static int course_degrees(int course) {		// 0 is unknown, 360 is north
+	return course == 0 ? -1 : course % 360;
+}
+
+static bool timestamp(const char* p, const char* end, aprs_packet& packet) {	// "DDHHMMz", "DDHHMM/" or "HHMMSSh"
+	if (end - p < 7 || number(p, 6) < 0 || (p[6] != 'z' && p[6] != '/' && p[6] != 'h')) return false;
+	packet.timestamp = view(p, p + 7);
+	return true;
+}
+
+static void comment(const char* p, const char* end, aprs_packet& packet) {	// the rest is comment, maybe with "/A=001234" in it
+	packet.text = view(p, end);
+	for (const char* a = p; (a = (const char*)memchr(a, '/', end - a)) != NULL && end - a >= 9; a++) {
+		if (a[1] != 'A' || a[2] != '=') continue;
+		int feet = a[3] == '-' ? number(a + 4, 5) : number(a + 3, 6);
+		if (feet < 0) continue;
+		packet.altitude = a[3] == '-' ? -feet : feet;
+		break;
+	}
+}
+
+// Positions. Each takes the bytes from 'p' and returns where they end, or
+// NULL if they aren't a position.
+
+static const char* position_uncompressed(const char* p, const char* end, aprs_packet& packet) {
+	if (end - p < APRS_POSITION_LEN) return NULL;
+	char b[APRS_POSITION_LEN];
+	memcpy(b, p, sizeof(b));
+	static const int BLANKABLE[8] = {2, 3, 5, 6, 12, 13, 15, 16};	// ambiguity: low digits sent as spaces
+	for (int i=0;i<8;i++) {
+		if (b[BLANKABLE[i]] == ' ') b[BLANKABLE[i]] = '0';
+	}
+	int lat_deg = number(b, 2), lat_min = number(b + 2, 2), lat_hun = number(b + 5, 2);
+	int lon_deg = number(b + 9, 3), lon_min = number(b + 12, 2), lon_hun = number(b + 15, 2);
+	if (lat_deg < 0 || lat_min < 0 || lat_hun < 0 || lon_deg < 0 || lon_min < 0 || lon_hun < 0) return NULL;
+	if (b[4] != '.' || b[14] != '.' || lat_deg > 90 || lon_deg > 180 || lat_min > 59 || lon_min > 59) return NULL;
+	if ((b[7] != 'N' && b[7] != 'S') || (b[17] != 'E' && b[17] != 'W')) return NULL;
+	packet.lat = lat_deg * 1000000L + minutes_udeg(lat_min * 100 + lat_hun);
+	packet.lon = lon_deg * 1000000L + minutes_udeg(lon_min * 100 + lon_hun);
+	if (b[7] == 'S') packet.lat = -packet.lat;
+	if (b[17] == 'W') packet.lon = -packet.lon;
+	packet.table = b[8];
+	packet.symbol = b[18];
+	packet.format = APRS_UNCOMPRESSED;
+	packet.has_position = true;
+	p += APRS_POSITION_LEN;
+	if (end - p >= 7 && p[3] == '/') {				// "ccc/sss" course and speed extension
+		int course = number(p, 3);
+		int speed = number(p + 4, 3);
+		if (course >= 0 && speed >= 0) {
+			packet.course = course_degrees(course);
+			packet.speed = speed * 100;
+			p += 7;
+		}
+	}
+	return p;
+}
+
+static long power_1002(int n) {				// 1.002^n, rounded, without libm
+	double result = 1.0, base = 1.002;
+	for (; n > 0; n >>= 1) {
+		if (n & 1) result *= base;
+		base *= base;
+	}
+	return (long)(result + 0.5);
+}
+
+static const char* position_compressed(const char* p, const char* end, aprs_packet& packet) {
+	if (end - p < APRS_COMPRESSED_LEN) return NULL;
+	long y = base91(p + 1, 4);
+	long x = base91(p + 5, 4);
+	if (y < 0 || x < 0) return NULL;
+	packet.lat = 90000000L - (y * 1000000LL + 190463) / 380926;	// the inverse of aprs_compressed(), rounded
+	packet.lon = (x * 1000000LL + 95231) / 190463 - 180000000L;
+	if (packet.lat < -90000000L || packet.lon > 180000000L) return NULL;
+	packet.table = p[0];
+	packet.symbol = p[9];
+	packet.format = APRS_COMPRESSED;
+	packet.has_position = true;
+	int c = p[10] - 33;
+	int s = p[11] - 33;
+	int t = p[12] - 33;
+	if (p[10] != ' ' && c >= 0 && s >= 0 && s < 91) {
+		if ((t >> 3 & 3) == 2) {					// origin is a GGA sentence, cs is altitude
+			packet.altitude = power_1002(c * 91 + s);
+		} else if (c < 90 && s < 90) {				// course and speed, '{' would be radio range
+			packet.course = c * 4;
+			packet.speed = SPEED_VALUES.value[s];
+		}
+	}
+	return p + APRS_COMPRESSED_LEN;
+}
+
+static const char* position(const char* p, const char* end, aprs_packet& packet) {	// either kind, by its first byte
+	if (p < end && *p >= '0' && *p <= '9') return position_uncompressed(p, end, packet);
+	return position_compressed(p, end, packet);	// its table is never a digit, overlays use 'a'-'j'
+}
+
+// A decoder per data type identifier. 'p' is just after it.
+
+typedef bool (*aprs_decoder)(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet);
+
+static bool decode_unknown(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet) {
+	packet.text = view(p - 1, end);
+	return true;
+}
+
+static bool decode_position(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet) {	// '!' and '='
+	packet.type = APRS_POSITION;
+	packet.messaging = p[-1] == '=';
+	const char* rest = position(p, end, packet);
+	if (rest == NULL) return false;
+	comment(rest, end, packet);
+	return true;
+}
+
+static bool decode_timestamped(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet) {	// '/' and '@'
+	packet.type = APRS_POSITION;
+	packet.messaging = p[-1] == '@';
+	if (!timestamp(p, end, packet)) return false;
+	const char* rest = position(p + 7, end, packet);
+	if (rest == NULL) return false;
+	comment(rest, end, packet);
+	return true;
+}
+
+static bool decode_object(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet) {	// ";NAME_____*DDHHMMzposition"
+	packet.type = APRS_OBJECT;
+	if (end - p < 10 || (p[9] != '*' && p[9] != '_')) return false;
+	packet.name = trimmed(p, 9);
+	packet.killed = p[9] == '_';
+	if (!timestamp(p + 10, end, packet)) return false;
+	const char* rest = position(p + 17, end, packet);
+	if (rest == NULL) return false;
+	comment(rest, end, packet);
+	return true;
+}
+
+static bool decode_item(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet) {	// ")NAME!position", 3 to 9 byte name
+	packet.type = APRS_ITEM;
+	int len = 0;
+	while (len < 10 && p + len < end && p[len] != '!' && p[len] != '_') len++;
+	if (len < 3 || len > 9 || p + len == end) return false;
+	packet.name = view(p, p + len);
+	packet.killed = p[len] == '_';
+	const char* rest = position(p + len + 1, end, packet);
+	if (rest == NULL) return false;
+	comment(rest, end, packet);
+	return true;
+}
+
+static bool decode_message(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet) {	// ":ADDRESSEE:text{id"
+	packet.type = APRS_MESSAGE;
+	if (end - p < 10 || p[9] != ':') return false;
+	packet.addressee = trimmed(p, 9);
+	const char* text = p + 10;
+	const char* text_end = end;
+	for (const char* b = end - 1; b >= text && b >= end - 6; b--) {	// a message id is at most 5 bytes
+		if (*b == '{') {
+			packet.message_id = view(b + 1, end);
+			text_end = b;
+			break;
+		}
+	}
+	packet.text = view(text, text_end);
+	return true;
+}
+
+static bool decode_status(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet) {	// ">text", maybe "DDHHMMz" first
+	packet.type = APRS_STATUS;
+	if (end - p >= 7 && p[6] == 'z' && timestamp(p, end, packet)) p += 7;
+	packet.text = view(p, end);
+	return true;
+}
+
+static bool decode_mice(const char* destination, int destination_len, const char* p, const char* end, aprs_packet& packet) {	// '`' and '\'', the latitude is in the destination
+	packet.type = APRS_POSITION;
+	if (end - p < APRS_MICE_LEN - 1 || destination_len < 6) return false;
+	int digit[6];
+	bool bit[6];
+	bool custom = false;
+	for (int i=0;i<6;i++) {
+		char c = destination[i];
+		if (c >= '0' && c <= '9') digit[i] = c - '0', bit[i] = false;
+		else if (c == 'L') digit[i] = 0, bit[i] = false;			// ambiguity, a space
+		else if (c >= 'P' && c <= 'Y') digit[i] = c - 'P', bit[i] = true;
+		else if (c == 'Z') digit[i] = 0, bit[i] = true;
+		else if (i < 3 && c >= 'A' && c <= 'J') digit[i] = c - 'A', bit[i] = true, custom = true;
+		else if (i < 3 && c == 'K') digit[i] = 0, bit[i] = true, custom = true;
+		else return false;
+	}
+	int lat_deg = digit[0] * 10 + digit[1];
+	int lat_min = digit[2] * 10 + digit[3];
+	int lat_hun = digit[4] * 10 + digit[5];
+	int lon_deg = p[0] - 28 + (bit[4] ? 100 : 0);
+	if (lon_deg >= 180 && lon_deg <= 189) lon_deg -= 80;
+	else if (lon_deg >= 190 && lon_deg <= 199) lon_deg -= 190;
+	int lon_min = p[1] - 28;
+	if (lon_min >= 60) lon_min -= 60;
+	int lon_hun = p[2] - 28;
+	if (lat_deg > 90 || lat_min > 59 || lon_deg < 0 || lon_deg > 180 || lon_min < 0 || lon_min > 59 || lon_hun < 0 || lon_hun > 99) return false;
+	packet.lat = lat_deg * 1000000L + minutes_udeg(lat_min * 100 + lat_hun);
+	packet.lon = lon_deg * 1000000L + minutes_udeg(lon_min * 100 + lon_hun);
+	if (!bit[3]) packet.lat = -packet.lat;			// set for north
+	if (bit[5]) packet.lon = -packet.lon;			// set for west
+	packet.mice_message = custom ? -1 : bit[0] << 2 | bit[1] << 1 | bit[2];
+
+	int sp = p[3] - 28;
+	int dc = p[4] - 28;
+	int se = p[5] - 28;
+	if (sp < 0 || dc < 0 || se < 0) return false;
+	int speed = sp * 10 + dc / 10;
+	if (speed >= 800) speed -= 800;
+	int course = dc % 10 * 100 + se;
+	if (course >= 400) course -= 400;
+	packet.speed = speed * 100;
+	packet.course = course_degrees(course);
+	packet.symbol = p[6];
+	packet.table = p[7];
+	packet.format = APRS_MICE;
+	packet.has_position = true;
+
+	const char* rest = p + APRS_MICE_LEN - 1;
+	packet.text = view(rest, end);
+	for (int i=0;i<2;i++) {							// "xxx}" altitude, maybe after a radio type byte
+		if (end - rest >= i + 4 && rest[i + 3] == '}') {
+			long meters = base91(rest + i, 3);
+			if (meters >= 0) packet.altitude = (meters - 10000) * 328084 / 100000;
+			break;
+		}
+	}
+	return true;
+}
+
+struct dispatch_table {
+	aprs_decoder decoder[256];
+	constexpr dispatch_table() : decoder() {
+		for (int i=0;i<256;i++) decoder[i] = &decode_unknown;
+		decoder['!'] = &decode_position;
+		decoder['='] = &decode_position;
+		decoder['/'] = &decode_timestamped;
+		decoder['@'] = &decode_timestamped;
+		decoder[';'] = &decode_object;
+		decoder[')'] = &decode_item;
+		decoder[':'] = &decode_message;
+		decoder['>'] = &decode_status;
+		decoder['`'] = &decode_mice;
+		decoder['\''] = &decode_mice;
+		decoder[0x1C] = &decode_mice;				// old Mic-E
+		decoder[0x1D] = &decode_mice;
+	}
+};
+static constexpr dispatch_table DISPATCH;
+
+bool aprs_decode(const char* destination, int destination_len, const char* info, int len, aprs_packet& packet) {
+	aprs_text empty = {info, 0};
+	packet.type = APRS_UNKNOWN;
+	packet.has_position = false;
+	packet.format = APRS_UNCOMPRESSED;
+	packet.lat = 0;
+	packet.lon = 0;
+	packet.table = 0;
+	packet.symbol = 0;
+	packet.speed = -1;
+	packet.course = -1;
+	packet.altitude = APRS_NO_ALTITUDE;
+	packet.messaging = false;
+	packet.mice_message = -1;
+	packet.timestamp = empty;
+	packet.name = empty;
+	packet.killed = false;
+	packet.addressee = empty;
+	packet.message_id = empty;
+	packet.text = empty;
+	if (len < 1) return false;
+	const char* dash = (const char*)memchr(destination, '-', destination_len);	// no SSID
+	if (dash != NULL) destination_len = dash - destination;
+	return DISPATCH.decoder[(unsigned char)info[0]](destination, destination_len, info + 1, info + len, packet);
+}	// END OF 'aprs_decode'
@@ -0,0 +1,96 @@
+// APRS payload encoding and decoding.
+
+#ifndef __APRS_H__
+#define __APRS_H__
+
+#define APRS_POSITION_LEN 19	// "DDMM.hhN/DDDMM.hhW>"
+#define APRS_COMPRESSED_LEN 13	// "/YYYYXXXX$csT"
+#define APRS_MICE_LEN 9			// Mic-E info field before the comment
+
+enum aprs_format {				// how to encode our own position
+	APRS_UNCOMPRESSED,			// "!DDMM.hhN/DDDMM.hhW>", 20 bytes
+	APRS_COMPRESSED,			// base91, 14 bytes
+	APRS_MICE					// latitude in the destination, 9 bytes
+};
+
+enum mice_message {				// Mic-E standard messages, the value is the A/B/C message bits
+	MICE_EMERGENCY = 0,
+	MICE_PRIORITY,
+	MICE_SPECIAL,
+	MICE_COMMITTED,
+	MICE_RETURNING,
+	MICE_IN_SERVICE,
+	MICE_EN_ROUTE,
+	MICE_OFF_DUTY
+};
+
+// Positions are in micro-degrees (negative for S/W) and speeds in hundredths
+// of a knot throughout, the same as a gps_fix. Encoding is integer only.
+
+// Write an uncompressed position ("4903.50N/07201.75W-") into 'out'
+// (APRS_POSITION_LEN bytes, not terminated). Returns the number of bytes
+// written.
+int aprs_position(char* out, long lat, long lon, char table, char symbol);
+
+// Write a base91 compressed position with course and speed (table, 4 + 4
+// position bytes, symbol, course, speed and compression type) into 'out'
+// (APRS_COMPRESSED_LEN bytes, not terminated). Course is in degrees.
+// Returns the number of bytes written.
+int aprs_compressed(char* out, long lat, long lon, int speed, int course, char table, char symbol);
+
+// Encode a Mic-E position: 6 destination callsign chars (latitude, N/S,
+// E/W, longitude offset and message bits) into 'destination', and the info
+// field (longitude, speed, course and symbol) into 'info' (APRS_MICE_LEN
+// bytes, not terminated). Course is in degrees. Returns the info length.
+int aprs_mice(char* destination, char* info, long lat, long lon, int speed, int course, char table, char symbol, int message);
+
+// Decoding
+
+enum aprs_type {				// what a decoded payload was
+	APRS_UNKNOWN,				// a data type we don't decode
+	APRS_POSITION,				// '!', '=', '/', '@', and Mic-E
+	APRS_OBJECT,				// ';'
+	APRS_ITEM,					// ')'
+	APRS_MESSAGE,				// ':', bulletins and acks included
+	APRS_STATUS					// '>'
+};
+
+struct aprs_text {				// part of the payload, pointing into it, not terminated
+	const char* ptr;
+	int len;
+};
+
+// A decoded payload. Plain data, nothing allocated: text fields point into
+// the payload and are only valid as long as it is. Fields a packet type
+// doesn't have are left empty or unknown.
+struct aprs_packet {
+	aprs_type type;
+	bool has_position;
+	aprs_format format;			// how the position was encoded
+	long lat;					// micro-degrees, negative for S
+	long lon;					// micro-degrees, negative for W
+	char table;
+	char symbol;
+	int speed;					// hundredths of a knot, -1 if not given
+	int course;					// degrees, -1 if not given
+	long altitude;				// feet, APRS_NO_ALTITUDE if not given
+	bool messaging;				// the station takes messages ('=', '@')
+	int mice_message;			// Mic-E message bits, see mice_message, -1 for a custom one or not Mic-E
+	aprs_text timestamp;		// "DDHHMMz", "HHMMSSh"... as sent
+	aprs_text name;				// object or item name, trailing spaces dropped
+	bool killed;				// object or item is being deleted
+	aprs_text addressee;		// message addressee, trailing spaces dropped
+	aprs_text message_id;		// after '{', empty if none
+	aprs_text text;				// comment, status or message text
+};
+
+#define APRS_NO_ALTITUDE (-0x7FFFFFFFL)
+
+// Decode an info field. 'destination' is the destination callsign as text
+// ("APRS", "S32U6T"; an SSID is ignored), only looked at for Mic-E. The data
+// type identifier picks the decoder from a 256 entry table. Returns false if
+// the payload is malformed; a data type we don't decode is not an error, it
+// comes back as APRS_UNKNOWN with the rest as text.
+bool aprs_decode(const char* destination, int destination_len, const char* info, int len, aprs_packet& packet);
+
+#endif  // __APRS_H__
@@ -0,0 +1,173 @@
+// AX.25 UI frame encoding and parsing, and KISS framing for outgoing frames.
+
+#include <cstring>
+#include "ax25.h"
+
+using std::string;
+using std::vector;
+
+void ax25_callsign(unsigned char* out, const char* callsign) {		// pad a callsign with spaces to 6 chars and shift chars to the left
+	int i = 0;
+	for (; i<6 && callsign[i]; i++) {
+		out[i] = callsign[i] << 1;		// shift all the chars in the input callsign
+	}
+	for (; i<6; i++) {
+		out[i] = 0x20 << 1;				// and pad the rest with shifted spaces
+	}
+}	// END OF 'ax25_callsign'
+
+bool ax25_address(unsigned char* out, const char* text) {	// parse and encode "CALL-SSID"
+	char call[7];
+	int len = 0;
+	while (text[len] && text[len] != '-') {
+		char c = text[len];
+		if (len == 6 || !((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) return false;
+		call[len++] = c >= 'a' ? c - 32 : c;	// callsigns go on the air in upper case
+	}
+	if (len == 0) return false;
+	call[len] = 0;
+	int ssid = 0;
+	if (text[len] == '-') {
+		const char* p = text + len + 1;
+		if (*p == 0) return false;
+		for (; *p; p++) {
+			if (*p < '0' || *p > '9') return false;
+			ssid = ssid * 10 + *p - '0';
+			if (ssid > 15) return false;
+		}
+	}
+	ax25_callsign(out, call);
+	out[6] = ax25_ssid(ssid, false, false);
+	return true;
+}	// END OF 'ax25_address'
+
+char ax25_ssid(char ssid, bool hbit, bool last) {	// format an ax25 ssid byte
+	ssid <<= 1;			// shift ssid
+	if (hbit) {			// set h and c bits
+		ssid |= 0xE0;	// 11100000
+	} else {
+		ssid |= 0x60;	// 01100000
+	}
+	ssid |= last;		// set address end bit
+	return ssid;
+}	// END OF 'ax25_ssid'
+
+int ax25_address_text(char* out, const unsigned char* addr) {	// unshift an address back into "CALL-SSID"
+	int len = 0;
+	for (int i=0;i<6;i++) {
+		char c = addr[i] >> 1;
+		if (c == ' ') break;		// padding, the callsign is done
+		out[len++] = c;
+	}
+	int ssid = (addr[6] >> 1) & 0x0F;
+	out[len++] = '-';
+	if (ssid >= 10) out[len++] = '1';
+	out[len++] = '0' + ssid % 10;
+	out[len] = 0;
+	return len;
+}	// END OF 'ax25_address_text'
+
+void ax25_build_header(ax25_header& header, const char* source, int source_ssid, const char* destination, int destination_ssid, const vector<string>& via, const vector<char>& via_ssids, const vector<bool>& via_hbits) {
+	unsigned char* p = header.data;
+	ax25_callsign(p, destination);								// add destination address
+	p[6] = ax25_ssid(destination_ssid, false, false);			// add destination ssid
+	p += AX25_ADDR_LEN;
+	ax25_callsign(p, source);									// add source address
+	int digis = via.size();
+	int hbits = via_hbits.size();
+	p[6] = ax25_ssid(source_ssid, false, digis == 0);			// end the address field here if there's no path
+	p += AX25_ADDR_LEN;
+	for (int i=0;i<digis;i++) {									// loop thru all via calls
+		bool hbit = i < hbits && via_hbits[i];
+		ax25_callsign(p, via[i].c_str());						// add this via callsign
+		p[6] = ax25_ssid(via_ssids[i], hbit, i == digis - 1);	// add this via ssid, ending the address field on the last one
+		p += AX25_ADDR_LEN;
+	}
+	*p++ = 0x03;												// add control and pid bytes (ui frame)
+	*p++ = 0xF0;
+	header.len = p - header.data;
+	header.digis = digis;
+
+	header.kiss[0] = KISS_FEND;									// add kiss header, escaped once here instead of every frame
+	header.kiss[1] = 0x00;
+	header.kiss_len = kiss_escape(header.kiss + 2, header.data, header.len) - header.kiss;
+}	// END OF 'ax25_build_header'
+
+void ax25_set_destination(ax25_header& header, const char* callsign) {
+	ax25_callsign(header.data, callsign);
+	memcpy(header.kiss + 2, header.data, 6);	// shifted alphanumerics never need escaping, so it's at the same place there
+}	// END OF 'ax25_set_destination'
+
+int ax25_airtime_ms(int len, int baud) {
+	return (len + 4) * 8 * 1000 / baud;		// + 2 FCS bytes and 2 flags
+}	// END OF 'ax25_airtime_ms'
+
+bool ax25_parse(const unsigned char* data, int len, ax25_frame& frame) {
+	int addresses = 0;
+	int pos = 0;
+	while (true) {								// walk the address field until the end bit
+		if (pos + AX25_ADDR_LEN > len || addresses == 2 + AX25_MAX_DIGIS) return false;
+		const unsigned char* addr = data + pos;
+		if (addresses == 0) frame.destination = addr;
+		else if (addresses == 1) frame.source = addr;
+		else frame.via[addresses - 2] = addr;
+		addresses++;
+		pos += AX25_ADDR_LEN;
+		if (addr[6] & 0x01) break;
+	}
+	if (addresses < 2 || pos + 2 > len) return false;
+	frame.digis = addresses - 2;
+	frame.address_len = pos;
+	frame.control = data[pos];
+	frame.pid = data[pos + 1];
+	if ((frame.control & ~0x10) != 0x03 || frame.pid != 0xF0) return false;	// UI frame (either poll/final), no layer 3
+	frame.info = data + pos + 2;
+	frame.info_len = len - pos - 2;
+	return true;
+}	// END OF 'ax25_parse'
+
+unsigned char* kiss_escape(unsigned char* out, const unsigned char* in, int len) {
+	for (int i=0;i<len;i++) {
+		unsigned char c = in[i];
+		if (c == KISS_FEND) {			// replace any FENDs with FESC,TFEND
+			*out++ = KISS_FESC;
+			*out++ = KISS_TFEND;
+		} else if (c == KISS_FESC) {	// replace any FESCs with FESC,TFESC
+			*out++ = KISS_FESC;
+			*out++ = KISS_TFESC;
+		} else {
+			*out++ = c;
+		}
+	}
+	return out;
+}	// END OF 'kiss_escape'
+
+int kiss_encode(unsigned char* out, int outlen, const ax25_header& header, const char* payload, int payload_len) {
+	if (payload_len > AX25_MAX_INFO || outlen < header.kiss_len + 2 * payload_len + 1) return -1;
+	memcpy(out, header.kiss, header.kiss_len);					// pre-encoded kiss header and address field
+	unsigned char* p = kiss_escape(out + header.kiss_len, (const unsigned char*)payload, payload_len);	// add the actual data
+	*p++ = KISS_FEND;											// add kiss footer
+	return p - out;
+}	// END OF 'kiss_encode'
+
+int kiss_wrap(unsigned char* out, int port, const unsigned char* frame, int len) {
+	out[0] = KISS_FEND;
+	unsigned char command = port << 4;							// data frame on 'port', port 12 makes a FEND
+	unsigned char* p = kiss_escape(out + 1, &command, 1);
+	p = kiss_escape(p, frame, len);
+	*p++ = KISS_FEND;
+	return p - out;
+}	// END OF 'kiss_wrap'
+
+int kiss_unwrap(unsigned char* out, const unsigned char* kiss, int len) {
+	unsigned char* p = out;
+	for (int i=kiss[1]==KISS_FESC?3:2;i<len && kiss[i]!=KISS_FEND;i++) {	// skip FEND and the command byte, escaped or not
+		if (kiss[i] == KISS_FESC && i + 1 < len) {
+			i++;
+			*p++ = kiss[i] == KISS_TFEND ? KISS_FEND : KISS_FESC;
+		} else {
+			*p++ = kiss[i];
+		}
+	}
+	return p - out;
+}	// END OF 'kiss_unwrap'
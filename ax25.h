@@ -0,0 +1,95 @@
+// AX.25 UI frame encoding and parsing, and KISS framing for outgoing frames.
+
+#ifndef __AX25_H__
+#define __AX25_H__
+
+#include <string>
+#include <vector>
+
+#define AX25_ADDR_LEN 7			// 6 shifted callsign chars + ssid byte
+#define AX25_MAX_DIGIS 8		// most digis allowed in a path
+#define AX25_MAX_HEADER (AX25_ADDR_LEN * (2 + AX25_MAX_DIGIS) + 2)	// full address field + control + pid
+#define AX25_MAX_INFO 256		// largest info field we will put in a frame
+#define KISS_MAX_FRAME (4 + 2 * (AX25_MAX_HEADER + AX25_MAX_INFO))	// FEND, command, FEND and every byte escaped, the command too
+
+#define KISS_FEND 0xC0			// frame end
+#define KISS_FESC 0xDB			// frame escape
+#define KISS_TFEND 0xDC			// transposed frame end
+#define KISS_TFESC 0xDD			// transposed frame escape
+
+// The address field, control and pid of a UI frame, encoded once and reused
+// for every frame sent with it. 'kiss' holds the same bytes already escaped
+// and prefixed with FEND and the KISS data command, ready to be copied out.
+struct ax25_header {
+	unsigned char data[AX25_MAX_HEADER];
+	int len;
+	unsigned char kiss[2 + 2 * AX25_MAX_HEADER];
+	int kiss_len;
+	int digis;					// number of via addresses
+};
+
+// A received UI frame, pointing into the buffer it was parsed from.
+struct ax25_frame {
+	const unsigned char* destination;	// 7 byte addresses
+	const unsigned char* source;
+	const unsigned char* via[AX25_MAX_DIGIS];
+	int digis;
+	int address_len;			// bytes in the address field
+	unsigned char control;
+	unsigned char pid;
+	const unsigned char* info;
+	int info_len;
+};
+
+// Pad a callsign with spaces to 6 chars and shift it into 'out' (6 bytes).
+void ax25_callsign(unsigned char* out, const char* callsign);
+
+// Encode "CALL" or "CALL-SSID" text as a 7 byte address (ssid byte with no
+// flag bits set). Returns false if it isn't a valid callsign.
+bool ax25_address(unsigned char* out, const char* text);
+
+// Format an AX.25 ssid byte.
+char ax25_ssid(char ssid, bool hbit, bool last);
+
+// Write "CALL-SSID" for the 7 byte address at 'addr' into 'out' (at least 10
+// bytes). Returns the text length.
+int ax25_address_text(char* out, const unsigned char* addr);
+
+// Encode the address field, control and pid of a UI frame into 'header'.
+// via_hbits may be left empty, in which case no H bits are set.
+void ax25_build_header(ax25_header& header, const char* source, int source_ssid,
+		const char* destination, int destination_ssid, const std::vector<std::string>& via,
+		const std::vector<char>& via_ssids, const std::vector<bool>& via_hbits = std::vector<bool>());
+
+// Replace the destination callsign (6 chars, no SSID) of an encoded header,
+// keeping its SSID byte.
+void ax25_set_destination(ax25_header& header, const char* callsign);
+
+// Rough time on the air for a raw AX.25 frame of 'len' bytes at 'baud',
+// counting FCS and flags but not TXDELAY or bit stuffing. In ms.
+int ax25_airtime_ms(int len, int baud);
+
+// Pick apart a raw AX.25 frame (no flags or FCS) without copying anything.
+// Returns false unless it is a well formed UI frame.
+bool ax25_parse(const unsigned char* data, int len, ax25_frame& frame);
+
+// Escape 'len' bytes from 'in' into 'out' (room for 2 * len bytes) and return
+// the end of the output.
+unsigned char* kiss_escape(unsigned char* out, const unsigned char* in, int len);
+
+// Write a complete KISS frame for 'header' + 'payload' into 'out' in a single
+// escaping pass. Returns the frame length, or -1 if the payload is too long
+// or 'outlen' can't hold the worst case (KISS_MAX_FRAME always can).
+int kiss_encode(unsigned char* out, int outlen, const ax25_header& header, const char* payload, int payload_len);
+
+// Wrap an already built AX.25 frame as a KISS data frame for 'port' (0-15).
+// 'out' needs room for 2 * len + 4 bytes, the command byte is escaped too;
+// KISS_MAX_FRAME holds any frame ax25_parse() accepts. Returns the KISS
+// frame length.
+int kiss_wrap(unsigned char* out, int port, const unsigned char* frame, int len);
+
+// Undo kiss_wrap() or kiss_encode(): unescape the frame between the command
+// byte and the closing FEND into 'out'. Returns its length.
+int kiss_unwrap(unsigned char* out, const unsigned char* kiss, int len);
+
+#endif  // __AX25_H__
@@ -0,0 +1,99 @@
+// Our own frames: the position report send_pos_report() sends, and the way
+// into the TX queue every frame we originate takes.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "aprs.h"
+#include "beacon.h"
+#include "INIReader.h"
+
+using namespace std;
+
+bool beacon_load(INIReader& config, beacon_config& beacon, smartbeacon& sb) {
+	beacon.via.clear();
+	beacon.via_ssids.clear();
+	string via = config.Get("beacon", "via", "");
+	for (size_t start=0;via.length()>0&&start<=via.length();) {
+		size_t comma = via.find(',', start);
+		if (comma == string::npos) comma = via.length();
+		string call = via.substr(start, comma - start);
+		unsigned char address[AX25_ADDR_LEN];
+		int dash = call.find('-');
+		int ssid = dash == -1 ? 0 : atoi(call.c_str() + dash + 1);
+		if (!ax25_address(address, call.c_str()) || ssid > 15) {	// checks the call is at most 6 characters, and the SSID a number
+			fprintf(stderr, "VIA: %s is not a valid callsign.\n", call.c_str());
+			return false;
+		}
+		beacon.via.push_back(call.substr(0, dash));
+		beacon.via_ssids.push_back(ssid);
+		start = comma + 1;
+	}
+	if (beacon.via.size() > AX25_MAX_DIGIS) {
+		fprintf(stderr, "VIA: Cannot have more than %i digis in the path.\n", AX25_MAX_DIGIS);
+		return false;
+	}
+
+	beacon.comment = config.Get("beacon", "comment", "");
+	string format = config.Get("beacon", "format", config.GetBoolean("beacon", "compressed", false) ? "compressed" : "uncompressed");
+	if (format == "uncompressed") beacon.format = APRS_UNCOMPRESSED;
+	else if (format == "compressed") beacon.format = APRS_COMPRESSED;
+	else if (format == "mic-e") beacon.format = APRS_MICE;
+	else {
+		fprintf(stderr, "BEACON: Format must be uncompressed, compressed or mic-e.\n");
+		return false;
+	}
+	const char* mice_messages[] = {"emergency", "priority", "special", "committed", "returning", "in_service", "en_route", "off_duty"};
+	string message = config.Get("beacon", "mice_message", "en_route");
+	for (beacon.mice_message = MICE_OFF_DUTY; beacon.mice_message >= 0 && message != mice_messages[beacon.mice_message]; beacon.mice_message--);
+	if (beacon.mice_message < 0) {
+		fprintf(stderr, "BEACON: Unknown Mic-E message %s.\n", message.c_str());
+		return false;
+	}
+	beacon.table = config.Get("beacon", "symbol_table", "/")[0];
+	beacon.symbol = config.Get("beacon", "symbol", "/")[0];
+
+	sb.static_rate = config.GetInteger("beacon", "static_rate", 900);	// how often (in seconds) to send a beacon if not using gps, set to 0 for SmartBeaconing
+	sb.low_speed = config.GetInteger("beacon", "sb_low_speed", 5);
+	sb.low_rate = config.GetInteger("beacon", "sb_low_rate", 1800);
+	sb.high_speed = config.GetInteger("beacon", "sb_high_speed", 60);
+	sb.high_rate = config.GetInteger("beacon", "sb_high_rate", 180);
+	sb.turn_min = config.GetInteger("beacon", "sb_turn_min", 30);
+	sb.turn_time = config.GetInteger("beacon", "sb_turn_time", 15);
+	sb.turn_slope = config.GetInteger("beacon", "sb_turn_slope", 255);
+	sb_reset(sb);
+	return true;
+}	// END OF 'beacon_load'
+
+void beacon_header(beacon_config& beacon, const char* call, int ssid) {
+	ax25_build_header(beacon.header, call, ssid, BEACON_TOCALL, 0, beacon.via, beacon.via_ssids);	// this never changes, so encode it once
+}	// END OF 'beacon_header'
+
+int beacon_encode(const beacon_config& beacon, const gps_fix& fix, char* info, ax25_header& mice, const ax25_header*& header) {
+	int len;
+	if (beacon.format == APRS_MICE) {		// the latitude goes in the destination, so this needs its own header
+		mice = beacon.header;
+		char destination[7] = {0};
+		len = aprs_mice(destination, info, fix.lat, fix.lon, fix.speed, fix.hdg, beacon.table, beacon.symbol, beacon.mice_message);
+		ax25_set_destination(mice, destination);
+		header = &mice;
+	} else {
+		info[0] = '!';						// no messaging
+		if (beacon.format == APRS_COMPRESSED) len = 1 + aprs_compressed(info + 1, fix.lat, fix.lon, fix.speed, fix.hdg, beacon.table, beacon.symbol);
+		else len = 1 + aprs_position(info + 1, fix.lat, fix.lon, beacon.table, beacon.symbol);
+		header = &beacon.header;
+	}
+	int comment_len = beacon.comment.length();
+	if (comment_len > AX25_MAX_INFO - len) comment_len = AX25_MAX_INFO - len;	// truncate rather than drop the beacon
+	memcpy(info + len, beacon.comment.c_str(), comment_len);
+	return len + comment_len;
+}	// END OF 'beacon_encode'
+
+int beacon_queue(dupe_filter& dupes, tx_queue& txq, int cls, const ax25_header& header, const char* payload, int payload_len, long long now) {
+	if (payload_len > AX25_MAX_INFO) return -1;		// before reserving, which may push out a queued frame
+	if (dupe_check(dupes, dupe_key(header.data, header.data + AX25_ADDR_LEN, (const unsigned char*)payload, payload_len), now)) return 0;
+	unsigned char* frame = txq_reserve(txq, cls);
+	int len = kiss_encode(frame, KISS_MAX_FRAME, header, payload, payload_len);
+	txq_commit(txq, cls, len, now);
+	return len;
+}	// END OF 'beacon_queue'
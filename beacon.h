@@ -0,0 +1,51 @@
+// Our own frames: the position report send_pos_report() sends, and the way
+// into the TX queue every frame we originate takes.
+
+#ifndef __BEACON_H__
+#define __BEACON_H__
+
+#include <string>
+#include <vector>
+#include "ax25.h"
+#include "dupe.h"
+#include "fix.h"
+#include "smartbeacon.h"
+#include "txq.h"
+
+#define BEACON_TOCALL "APMGT1"	// destination of everything we send, says what software sent it
+
+class INIReader;
+
+struct beacon_config {			// how we send our position, from the [beacon] section
+	ax25_header header;			// address field, encoded once by beacon_header()
+	std::vector<std::string> via;	// path callsigns
+	std::vector<char> via_ssids;
+	int format;					// an aprs_format
+	int mice_message;			// Mic-E standard message, a mice_message
+	char table;					// symbol table
+	char symbol;				// symbol code
+	std::string comment;		// sent after the position, truncated to fit
+};
+
+// Read the [beacon] section: the path, format, Mic-E message, symbol and
+// comment into 'beacon', and the SmartBeaconing settings into 'sb', which is
+// then reset. The same keys and defaults for the tracker and its tools.
+// Returns false, having said what was wrong, on a bad setting.
+bool beacon_load(INIReader& config, beacon_config& beacon, smartbeacon& sb);
+
+// Encode the address field for beacons from 'call'-'ssid' to BEACON_TOCALL
+// along the configured path.
+void beacon_header(beacon_config& beacon, const char* call, int ssid);
+
+// Encode a position report for 'fix' into 'info' (AX25_MAX_INFO bytes) and
+// point 'header' at the address field to send it with: the configured one,
+// or for Mic-E a copy in 'mice' with the latitude in the destination.
+// Returns the info length.
+int beacon_encode(const beacon_config& beacon, const gps_fix& fix, char* info, ax25_header& mice, const ax25_header*& header);
+
+// Queue a frame of ours in class 'cls', KISS encoded straight into its slot,
+// unless 'dupes' has seen the same one within its window. Returns the KISS
+// frame length, 0 if it was a dupe, or -1 if the payload is too long.
+int beacon_queue(dupe_filter& dupes, tx_queue& txq, int cls, const ax25_header& header, const char* payload, int payload_len, long long now);
+
+#endif  // __BEACON_H__
@@ -0,0 +1,140 @@
+// Benchmark for the AFSK demodulator: real time factor and frames decoded.
+//
+//	cmake --build build --target afsk_bench
+//	./build/afsk_bench [-d decoders] [file.wav ...]
+//
+// With no files it makes its own: a few hundred random UI frames through the
+// modulator, clean and then with noise, de-emphasis and pre-emphasis, and
+// reports how many of them came back.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "../ax25.h"
+#include "../hdlc.h"
+#include "../afsk.h"
+#include "../demod.h"
+
+using namespace std;
+
+#define BENCH_FRAMES 500
+#define BENCH_RATE 48000
+
+static double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum impairment {CLEAN, NOISE, DEEMPHASIS, PREEMPHASIS};
+static const char* IMPAIRMENTS[] = {"clean", "noise", "deemphasis", "preemphasis"};
+
+static float gaussian(unsigned int& seed) {		// Box-Muller, good enough for noise
+	float u = (rand_r(&seed) + 1.0f) / (RAND_MAX + 2.0f);
+	float v = rand_r(&seed) / (RAND_MAX + 1.0f);
+	return sqrtf(-2 * logf(u)) * cosf(2 * M_PI * v);
+}
+
+static bool make_wav(const char* path, impairment kind) {	// BENCH_FRAMES transmissions, a quiet gap between each
+	afsk_modulator mod;
+	pcm_output out;
+	afsk_init(mod, BENCH_RATE, 50);
+	if (!pcm_open(out, path, BENCH_RATE)) return false;
+	int max_bits = HDLC_MAX_BITS(AX25_MAX_HEADER + AX25_MAX_INFO, 40);
+	unsigned char* bits = new unsigned char[max_bits];
+	int max_samples = afsk_max_samples(mod, max_bits) + BENCH_RATE / 10;
+	short* samples = new short[max_samples];
+	unsigned int seed = 1;
+	float state = 0, last = 0;
+	unsigned char tone = 1;
+	ax25_header header;
+	ax25_build_header(header, "N0CALL", 9, "APRS", 0, {"WIDE1", "WIDE2"}, {1, 1});
+	for (int f=0;f<BENCH_FRAMES;f++) {
+		unsigned char frame[AX25_MAX_HEADER + AX25_MAX_INFO];
+		memcpy(frame, header.data, header.len);
+		int info = 20 + rand_r(&seed) % 60;
+		for (int i=0;i<info;i++) frame[header.len + i] = ' ' + rand_r(&seed) % 95;
+		int count = hdlc_encode(tone, bits, frame, header.len + info, 30, 3);
+		int n = afsk_modulate(mod, bits, count, samples);
+		for (int i=0;i<BENCH_RATE/10;i++) samples[n++] = 0;	// 100 ms off the air
+		for (int i=0;i<n;i++) {
+			float x = samples[i];
+			if (kind == NOISE) x += gaussian(seed) * 8000;	// about 3 dB SNR
+			if (kind == DEEMPHASIS) x = state = state + (x - state) * 0.12f;	// one pole low pass, space 5 dB down
+			if (kind == PREEMPHASIS) {						// first difference, space 5 dB up
+				float y = (x - 0.7f * last) * 1.5f;
+				last = x;
+				x = y;
+			}
+			samples[i] = x > 32767 ? 32767 : x < -32768 ? -32768 : x;
+		}
+		if (!pcm_write(out, samples, n)) return false;
+	}
+	pcm_close(out);
+	delete[] bits;
+	delete[] samples;
+	return true;
+}
+
+static bool run(const char* path, int decoders, int expected) {
+	afsk_demod demod;
+	int event_fd = eventfd(0, EFD_CLOEXEC);
+	double start = now_seconds();
+	if (!demod_open(demod, path, BENCH_RATE, decoders, event_fd)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return false;
+	}
+	demod_frame frame;
+	while (true) {										// take frames as they come, the way the daemon does
+		struct pollfd pfd = {event_fd, POLLIN, 0};
+		uint64_t count;
+		if (poll(&pfd, 1, 10) == 1) read(event_fd, &count, sizeof(count));
+		while (demod_next(demod, frame));
+		pthread_mutex_lock(&demod.lock);
+		bool done = demod.running == 0;
+		pthread_mutex_unlock(&demod.lock);
+		if (done) break;
+	}
+	demod_wait(demod);
+	while (demod_next(demod, frame));
+	double elapsed = now_seconds() - start;
+	close(event_fd);
+	double audio = (double)demod.samples / demod.sample_rate;
+	printf("%-28s %7.1f s audio %8.3f s %7.0fx real time  %5lu frames", path, audio, elapsed, audio / elapsed, demod.frames);
+	if (expected > 0) printf(" of %d", expected);
+	printf("  (");
+	for (int i=0;i<demod.decoder_count;i++) printf("%s%lu", i ? " " : "", demod.decoders[i].frames);
+	printf(")\n");
+	return true;
+}
+
+int main(int argc, char** argv) {
+	int decoders = 3;
+	int arg = 1;
+	if (arg + 1 < argc && strcmp(argv[arg], "-d") == 0) {
+		decoders = atoi(argv[arg + 1]);
+		arg += 2;
+	}
+	printf("%d decoders, frames per decoder in brackets\n", decoders);
+	if (arg < argc) {
+		for (; arg < argc; arg++) run(argv[arg], decoders, 0);
+		return EXIT_SUCCESS;
+	}
+	for (int kind=CLEAN;kind<=PREEMPHASIS;kind++) {
+		string path = string("/tmp/afsk_bench_") + IMPAIRMENTS[kind] + ".wav";
+		if (!make_wav(path.c_str(), (impairment)kind)) {
+			fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+			return EXIT_FAILURE;
+		}
+		run(path.c_str(), decoders, BENCH_FRAMES);
+		unlink(path.c_str());
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+// Benchmark for the APRS payload decoder: packets per second on one core.
+//
+//	cmake --build build --target aprs_bench
+//	./build/aprs_bench [dump.txt ...]
+//
+// Files are APRS-IS style text, one "SRC>DEST,PATH:payload" per line, like
+// an archive dump. With no files it decodes a synthetic mix made with our
+// own encoders plus objects, items, messages and status.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "../aprs.h"
+
+using namespace std;
+
+struct bench_packet {			// a line split into its destination and payload
+	const char* destination;
+	int destination_len;
+	const char* info;
+	int len;
+};
+
+static double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool split(const char* line, int len, bench_packet& packet) {	// "SRC>DEST,PATH:payload"
+	const char* end = line + len;
+	const char* gt = (const char*)memchr(line, '>', len);
+	const char* colon = (const char*)memchr(line, ':', len);
+	if (gt == NULL || colon == NULL || colon < gt) return false;
+	const char* dest_end = gt + 1;
+	while (dest_end < colon && *dest_end != ',') dest_end++;
+	packet.destination = gt + 1;
+	packet.destination_len = dest_end - gt - 1;
+	packet.info = colon + 1;
+	packet.len = end - colon - 1;
+	return true;
+}
+
+static void load(const char* path, vector<char>& text) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+	char buff[65536];
+	int n;
+	while ((n = read(fd, buff, sizeof(buff))) > 0) text.insert(text.end(), buff, buff + n);
+	close(fd);
+	text.push_back('\n');
+}
+
+static void synthesize(vector<char>& text) {		// 10000 lines, a typical mix of types
+	srand(1);
+	for (int i=0;i<10000;i++) {
+		long lat = (long)(rand() % 180000000) - 90000000;
+		long lon = (long)(rand() % 360000000) - 180000000;
+		int speed = rand() % 10000;
+		int course = rand() % 360;
+		char line[256];
+		char payload[128];
+		char destination[7] = "APRS";
+		int len = 0;
+		switch (i % 11) {
+		case 0: case 1: case 2:
+			payload[0] = '!';
+			len = 1 + aprs_position(payload + 1, lat, lon, '/', '>');
+			len += sprintf(payload + len, "%03d/%03d/A=001234 mobile", course, speed / 100);
+			break;
+		case 3: case 4:
+			payload[0] = '=';
+			len = 1 + aprs_compressed(payload + 1, lat, lon, speed, course, '/', '>');
+			len += sprintf(payload + len, "compressed");
+			break;
+		case 5: case 6:
+			len = aprs_mice(destination, payload, lat, lon, speed, course, '/', '>', MICE_EN_ROUTE);
+			destination[6] = 0;
+			len += sprintf(payload + len, "]=");
+			break;
+		case 7:
+			len = sprintf(payload, ";OBJ%05d *092345z", i);
+			len += aprs_position(payload + len, lat, lon, '/', 'E');
+			break;
+		case 10:
+			len = sprintf(payload, ")IT%d!", i % 1000000);		// 3 to 9 byte name
+			len += aprs_position(payload + len, lat, lon, '/', 'E');
+			break;
+		case 8:
+			len = sprintf(payload, ":N0CALL-%-2d:message number %d{%d", i % 16, i, i % 1000);
+			break;
+		case 9:
+			len = sprintf(payload, ">092345zstatus text %d", i);
+			break;
+		}
+		int n = sprintf(line, "N0CALL-%d>%s,WIDE1-1,qAR,N0CALL:", i % 16, destination);
+		text.insert(text.end(), line, line + n);
+		text.insert(text.end(), payload, payload + len);
+		text.push_back('\n');
+	}
+}
+
+int main(int argc, char** argv) {
+	vector<char> text;
+	if (argc > 1) {
+		for (int i=1;i<argc;i++) load(argv[i], text);
+	} else {
+		synthesize(text);
+	}
+
+	vector<bench_packet> packets;
+	const char* p = text.data();
+	const char* end = p + text.size();
+	while (p < end) {
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		int len = eol - p;
+		if (len > 0 && p[len-1] == '\r') len--;
+		bench_packet packet;
+		if (len > 0 && p[0] != '#' && split(p, len, packet)) packets.push_back(packet);	// '#' is a server comment
+		p = eol + 1;
+	}
+	if (packets.empty()) {
+		fprintf(stderr, "No packets\n");
+		return EXIT_FAILURE;
+	}
+
+	unsigned long types[APRS_STATUS + 1] = {0};
+	unsigned long failed = 0, positions = 0;
+	unsigned long decoded = 0;
+	long long checksum = 0;							// so the work can't be optimized away
+	double start = now_seconds();
+	double elapsed;
+	int passes = 0;
+	do {											// at least a second's worth
+		for (size_t i=0;i<packets.size();i++) {
+			aprs_packet packet;
+			const bench_packet& b = packets[i];
+			bool ok = aprs_decode(b.destination, b.destination_len, b.info, b.len, packet);
+			checksum += packet.lat + packet.text.len;
+			if (passes == 0) {
+				if (!ok) failed++;
+				else types[packet.type]++;
+				if (packet.has_position) positions++;
+			}
+		}
+		decoded += packets.size();
+		passes++;
+		elapsed = now_seconds() - start;
+	} while (elapsed < 1.0);
+
+	static const char* NAMES[] = {"unknown", "position", "object", "item", "message", "status"};
+	printf("%zu packets, %i passes: %.1f M packets/s, %.1f ns/packet (%llx)\n", packets.size(), passes, decoded / elapsed / 1e6, elapsed * 1e9 / decoded, checksum & 0xFFFF);
+	for (int i=0;i<=APRS_STATUS;i++) printf("  %-9s %lu\n", NAMES[i], types[i]);
+	printf("  %-9s %lu\n  %-9s %lu\n", "failed", failed, "with position", positions);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,324 @@
+// Microbenchmarks for the encode and parse hot paths: ns/op and allocations/op.
+//
+//	cmake --build build --target hotpath_bench
+//	./build/hotpath_bench [-m seconds] [-j results.json] [-b baseline.json] [-t percent] [name ...]
+//
+// Covers address encoding, KISS framing, each send_pos_report() format from
+// fix through the dupe filter into the TX queue (the tracker's own
+// beacon_encode() and beacon_queue()), RMC parsing as in gps_thread(), and
+// INIReader lookups. Each case is timed in batches for
+// about 'seconds' (0.5) and the best batch is reported. Allocations are
+// counted through operator new, so this counts C++ allocations only.
+//
+// -j writes the results as JSON, one case per line, to keep as a baseline.
+// -b compares against one: a case more than 'percent' (10) slower, or
+// allocating more, is a regression and the exit status is 1. Names limit
+// the run to cases containing any of them.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include "../ax25.h"
+#include "../aprs.h"
+#include "../beacon.h"
+#include "../dupe.h"
+#include "../nmea.h"
+#include "../txq.h"
+#include "../INIReader.h"
+
+using namespace std;
+
+static unsigned long allocations = 0;	// operator new calls so far, single threaded
+
+void* operator new(size_t size) {
+	allocations++;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+static volatile long long sink;			// results go here so the work can't be optimized away
+
+// Inputs, set up once in main()
+static ax25_header header;
+static beacon_config beacon;
+static dupe_filter dupes;
+static tx_queue txq;
+static long long clock_ms;				// moves on a second per beacon, across batches too, so the dupe filter sees time pass
+static INIReader* config;
+static const char* COMMENT = "APRS Toolkit mobile";
+static const char* RMC = "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A";
+
+static double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The cases. Each runs its operation 'n' times and returns something that
+// depends on every run.
+
+static long long bench_callsign(long n) {
+	static const char* CALLS[2] = {"N0CALL", "WB4APR"};
+	unsigned char out[6];
+	long long sum = 0;
+	for (long i=0;i<n;i++) {
+		ax25_callsign(out, CALLS[i & 1]);
+		sum += out[i % 6];
+	}
+	return sum;
+}
+
+static long long bench_ssid(long n) {
+	long long sum = 0;
+	for (long i=0;i<n;i++) sum += ax25_ssid(i & 15, i & 16, i & 32);
+	return sum;
+}
+
+static long long bench_kiss_frame(long n) {
+	unsigned char frame[KISS_MAX_FRAME];
+	char payload[64];
+	int len = sprintf(payload, "!4903.50N/07201.75W>%s", COMMENT);
+	long long sum = 0;
+	for (long i=0;i<n;i++) {
+		payload[1] = '0' + (i & 7);
+		sum += kiss_encode(frame, sizeof(frame), header, payload, len);
+	}
+	return sum;
+}
+
+static long long bench_position(long n, aprs_format format) {	// what send_pos_report() does, fix to a frame in the TX queue
+	beacon.format = format;
+	gps_fix fix = gps_fix();
+	char pos[AX25_MAX_INFO];
+	ax25_header mice;
+	const ax25_header* frame_header;
+	long long sum = 0;
+	for (long i=0;i<n;i++) {
+		clock_ms += 1000;						// a beacon a second
+		long t = clock_ms / 1000;
+		fix.lat = 48117300 + (t & 1023) * 200;	// coarser than any format, and repeating every 1024 s, long after the dupe window
+		fix.lon = -11516667 - (t & 1023) * 200;
+		fix.speed = 3000 + (t & 255);
+		fix.hdg = t % 360;
+		int len = beacon_encode(beacon, fix, pos, mice, frame_header);
+		sum += beacon_queue(dupes, txq, TX_BEACON, *frame_header, pos, len, clock_ms);
+	}
+	return sum;
+}
+
+static long long bench_uncompressed(long n) {
+	return bench_position(n, APRS_UNCOMPRESSED);
+}
+
+static long long bench_compressed(long n) {
+	return bench_position(n, APRS_COMPRESSED);
+}
+
+static long long bench_mice(long n) {
+	return bench_position(n, APRS_MICE);
+}
+
+static long long bench_rmc(long n) {
+	int len = strlen(RMC);
+	nmea_sentence sentence;
+	nmea_rmc rmc;
+	long long sum = 0;
+	for (long i=0;i<n;i++) {
+		if (nmea_parse(RMC, len, sentence) && nmea_parse_rmc(sentence, rmc)) sum += rmc.lat + rmc.speed;
+	}
+	return sum;
+}
+
+static long long bench_ini_get(long n) {
+	long long sum = 0;
+	for (long i=0;i<n;i++) sum += config->Get("beacon", "comment", "").length();
+	return sum;
+}
+
+static long long bench_ini_integer(long n) {
+	long long sum = 0;
+	for (long i=0;i<n;i++) sum += config->GetInteger("tnc", "baud", 9600);
+	return sum;
+}
+
+struct bench_case {
+	const char* name;
+	long long (*run)(long n);
+};
+
+static const bench_case CASES[] = {
+	{"ax25_callsign", bench_callsign},
+	{"ax25_ssid", bench_ssid},
+	{"kiss_frame", bench_kiss_frame},
+	{"pos_report_uncompressed", bench_uncompressed},
+	{"pos_report_compressed", bench_compressed},
+	{"pos_report_mice", bench_mice},
+	{"rmc_parse", bench_rmc},
+	{"ini_get", bench_ini_get},
+	{"ini_get_integer", bench_ini_integer}
+};
+
+struct bench_result {
+	string name;
+	double ns;
+	double allocs;
+};
+
+static bench_result measure(const bench_case& c, double seconds) {
+	long n = 1;
+	double elapsed = 0;
+	while (true) {									// a batch of at least 10 ms
+		double start = now_seconds();
+		sink = c.run(n);
+		elapsed = now_seconds() - start;
+		if (elapsed >= 0.01) break;
+		n *= elapsed < 0.001 ? 10 : 2;
+	}
+	bench_result result = {c.name, elapsed * 1e9 / n, 0};
+	unsigned long before = allocations;
+	int batches = 0;
+	for (double spent = 0; spent < seconds || batches < 3; spent += elapsed, batches++) {	// best of the batches
+		double start = now_seconds();
+		sink = c.run(n);
+		elapsed = now_seconds() - start;
+		if (elapsed * 1e9 / n < result.ns) result.ns = elapsed * 1e9 / n;
+	}
+	result.allocs = (double)(allocations - before) / ((double)n * batches);
+	return result;
+}
+
+static void save(const char* path, const vector<bench_result>& results) {
+	FILE* out = fopen(path, "w");
+	if (out == NULL) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+	fprintf(out, "{\"benchmarks\": [\n");
+	for (size_t i=0;i<results.size();i++) {
+		fprintf(out, "  {\"name\": \"%s\", \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f}%s\n", results[i].name.c_str(), results[i].ns, results[i].allocs, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "]}\n");
+	fclose(out);
+}
+
+static vector<bench_result> load(const char* path) {	// what save() wrote, a case per line
+	FILE* in = fopen(path, "r");
+	if (in == NULL) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+	vector<bench_result> results;
+	char line[256];
+	while (fgets(line, sizeof(line), in) != NULL) {
+		char name[64];
+		bench_result result;
+		if (sscanf(line, " {\"name\": \"%63[^\"]\", \"ns_per_op\": %lf, \"allocs_per_op\": %lf", name, &result.ns, &result.allocs) != 3) continue;
+		result.name = name;
+		results.push_back(result);
+	}
+	fclose(in);
+	return results;
+}
+
+int main(int argc, char** argv) {
+	double seconds = 0.5;
+	const char* json = NULL;
+	const char* baseline = NULL;
+	double threshold = 10;
+	int c;
+	while ((c = getopt(argc, argv, "m:j:b:t:")) != -1) {
+		switch (c) {
+		case 'm': seconds = atof(optarg); break;
+		case 'j': json = optarg; break;
+		case 'b': baseline = optarg; break;
+		case 't': threshold = atof(optarg); break;
+		default:
+			fprintf(stderr, "Usage: hotpath_bench [-m seconds] [-j results.json] [-b baseline.json] [-t percent] [name ...]\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	vector<string> path_calls = {"WIDE1", "WIDE2"};
+	vector<char> path_ssids = {1, 1};
+	ax25_build_header(header, "N0CALL", 9, BEACON_TOCALL, 0, path_calls, path_ssids);
+	beacon.header = header;
+	beacon.mice_message = MICE_EN_ROUTE;
+	beacon.table = '/';
+	beacon.symbol = '>';
+	beacon.comment = COMMENT;
+	dupe_init(dupes, 4096, DUPE_WINDOW);
+	txq_init(txq, 1200, 100, 60, 0);			// no airtime budget, the queue just keeps its newest frames
+	char ini[] = "/tmp/hotpath_bench.XXXXXX";		// a config like a real one, so the map is a realistic size
+	int fd = mkstemp(ini);
+	if (fd == -1) {
+		fprintf(stderr, "%s: %s\n", ini, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	FILE* f = fdopen(fd, "w");
+	fprintf(f, "[station]\nmycall = N0CALL-9\n[gps]\nenable = yes\nport = /dev/ttyUSB1\nbaud = 4800\n[tnc]\nport = /dev/ttyUSB0\nbaud = 9600\nradio_baud = 1200\n");
+	fprintf(f, "[beacon]\nvia = WIDE1-1,WIDE2-1\nformat = compressed\ncomment = %s\nsymbol_table = /\nsymbol = >\n", COMMENT);
+	fprintf(f, "static_rate = 0\nsb_low_speed = 5\nsb_low_rate = 1800\nsb_high_speed = 60\nsb_high_rate = 180\nsb_turn_min = 30\nsb_turn_time = 15\nsb_turn_slope = 255\n");
+	fprintf(f, "[dupe]\nentries = 4096\nwindow = 30\n[channel]\nwindow = 300\ntarget = 30\n");
+	fclose(f);
+	INIReader reader(ini);
+	config = &reader;
+	unlink(ini);
+	if (config->ParseError() != 0) {
+		fprintf(stderr, "Could not parse the test config\n");
+		return EXIT_FAILURE;
+	}
+
+	vector<bench_result> results;
+	for (const bench_case& c : CASES) {
+		bool wanted = optind == argc;
+		for (int i=optind;i<argc;i++) wanted |= strstr(c.name, argv[i]) != NULL;
+		if (wanted) results.push_back(measure(c, seconds));
+	}
+
+	vector<bench_result> base;
+	if (baseline != NULL) base = load(baseline);
+	bool regressed = false;
+	printf("%-26s %10s %10s", "benchmark", "ns/op", "allocs/op");
+	if (baseline != NULL) printf(" %10s %8s", "base ns/op", "change");
+	printf("\n");
+	for (const bench_result& r : results) {
+		printf("%-26s %10.2f %10.2f", r.name.c_str(), r.ns, r.allocs);
+		for (const bench_result& b : base) {
+			if (b.name != r.name) continue;
+			double change = (r.ns - b.ns) * 100 / b.ns;
+			bool worse = change > threshold || r.allocs > b.allocs + 0.005;
+			printf(" %10.2f %+7.1f%%%s", b.ns, change, worse ? "  REGRESSED" : "");
+			regressed |= worse;
+		}
+		printf("\n");
+	}
+	if (json != NULL) save(json, results);
+	return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,49 @@
+// Channel occupancy over a sliding window, from what we hear and send.
+
+#include "channel.h"
+
+void channel_init(channel_load& channel, int window, long long now) {
+	channel.buckets = new int[window];
+	for (int i=0;i<window;i++) channel.buckets[i] = 0;
+	channel.size = window;
+	channel.second = now / 1000;
+	channel.total = 0;
+	channel.target = 100;
+	channel.min_scale = 100;
+	channel.max_scale = 100;
+}	// END OF 'channel_init'
+
+static void slide(channel_load& channel, long long now) {	// empty the buckets for the seconds since the newest one
+	long long second = now / 1000;
+	if (second <= channel.second) return;
+	if (second - channel.second >= channel.size) {		// quiet for a whole window
+		for (int i=0;i<channel.size;i++) channel.buckets[i] = 0;
+		channel.total = 0;
+	} else {
+		for (long long s=channel.second+1;s<=second;s++) {
+			int& bucket = channel.buckets[s % channel.size];
+			channel.total -= bucket;
+			bucket = 0;
+		}
+	}
+	channel.second = second;
+}
+
+void channel_add(channel_load& channel, int airtime, long long now) {
+	slide(channel, now);
+	channel.buckets[channel.second % channel.size] += airtime;
+	channel.total += airtime;
+}	// END OF 'channel_add'
+
+int channel_busy(channel_load& channel, long long now) {
+	slide(channel, now);
+	return channel.total * 100 / (channel.size * 1000LL);
+}	// END OF 'channel_busy'
+
+int channel_scale(channel_load& channel, long long now) {
+	slide(channel, now);
+	int scale = channel.total * 10 / (channel.size * channel.target);	// (total / window ms * 100) / target * 100
+	if (scale < channel.min_scale) scale = channel.min_scale;
+	if (scale > channel.max_scale) scale = channel.max_scale;
+	return scale;
+}	// END OF 'channel_scale'
@@ -0,0 +1,33 @@
+// Channel occupancy over a sliding window, from what we hear and send.
+
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+// Airtime is kept in one bucket per second of the window plus a running
+// total, so adding a frame and reading the load are O(1); the buckets that
+// slide out of the window are subtracted as time moves on. Sized once by
+// channel_init().
+struct channel_load {
+	int* buckets;				// ms of airtime in each second, a ring
+	int size;					// window, in seconds
+	long long second;			// the second the newest bucket is for
+	long long total;			// sum of the buckets, ms
+	int target;					// busy percent where the rate scale is 100
+	int min_scale;				// limits on the rate scale, percent
+	int max_scale;
+};
+
+void channel_init(channel_load& channel, int window, long long now);
+
+// Count 'airtime' ms of transmission (heard or our own) at 'now'.
+void channel_add(channel_load& channel, int airtime, long long now);
+
+// How busy the channel was over the window, in percent.
+int channel_busy(channel_load& channel, long long now);
+
+// How much to stretch beacon intervals for the current load, in percent:
+// busy / target, kept between min_scale and max_scale. Everyone running
+// this on the same channel sees the same load and backs off together.
+int channel_scale(channel_load& channel, long long now);
+
+#endif  // __CHANNEL_H__
@@ -0,0 +1,402 @@
+// Bell 202 AFSK demodulator, several decoders in parallel, the receive half of a soft TNC.
+
+#include <cmath>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <sched.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "afsk.h"
+#include "hdlc.h"
+#include "demod.h"
+
+typedef float demod_floats __attribute__((vector_size(AFSK_VECTOR * sizeof(float))));
+
+static const struct {			// what each decoder does differently, in the order they're started
+	bool prefilter;
+	float space_gain;
+} VARIANTS[DEMOD_MAX_DECODERS] = {
+	{false, 1.0f},				// flat audio
+	{true, 1.0f},				// flat, noisy
+	{false, 2.0f},				// de-emphasized, the usual from a speaker jack
+	{false, 0.5f},				// pre-emphasized, straight off the discriminator
+	{true, 2.0f},
+	{true, 0.5f},
+	{false, 1.4f},
+	{false, 0.7f}
+};
+
+static int padded(int n) {		// round up to the vector width
+	return (n + AFSK_VECTOR - 1) / AFSK_VECTOR * AFSK_VECTOR;
+}
+
+static float* floats(int n) {	// zeroed and aligned for the vector loads
+	float* p = new (std::align_val_t(32)) float[n];
+	memset(p, 0, n * sizeof(float));
+	return p;
+}
+
+static void decoder_init(afsk_decoder& d, afsk_demod& demod, int index) {
+	int rate = demod.sample_rate;
+	d.demod = &demod;
+	d.index = index;
+	d.prefilter = VARIANTS[index].prefilter;
+	d.space_gain = VARIANTS[index].space_gain;
+
+	int bit_len = (rate + AFSK_BAUD / 2) / AFSK_BAUD;		// correlate over one bit, the newest samples at the end
+	d.taps = padded(bit_len);
+	d.corr = floats(4 * d.taps);
+	int tones[2] = {AFSK_MARK, AFSK_SPACE};
+	for (int t=0;t<2;t++) {
+		for (int i=0;i<bit_len;i++) {
+			double w = 2 * M_PI * tones[t] * i / rate;
+			d.corr[(2 * t) * d.taps + d.taps - bit_len + i] = cos(w);
+			d.corr[(2 * t + 1) * d.taps + d.taps - bit_len + i] = sin(w);
+		}
+	}
+	d.hist = floats(2 * d.taps);
+	d.hist_pos = 0;
+
+	int bp_len = bit_len * 3 / 2 | 1;						// windowed sinc band pass, 900-2500 Hz
+	d.bp_taps = padded(bp_len);
+	d.bp = floats(d.bp_taps);
+	for (int i=0;i<bp_len;i++) {
+		double m = i - bp_len / 2;
+		double f1 = 900.0 / rate, f2 = 2500.0 / rate;
+		double h = m == 0 ? 2 * (f2 - f1) : (sin(2 * M_PI * f2 * m) - sin(2 * M_PI * f1 * m)) / (M_PI * m);
+		d.bp[d.bp_taps - bp_len + i] = h * (0.54 - 0.46 * cos(2 * M_PI * i / (bp_len - 1)));	// Hamming
+	}
+	d.bp_hist = floats(2 * d.bp_taps);
+	d.bp_pos = 0;
+
+	d.pll = 0;
+	d.pll_step = (int)(4294967296.0 * AFSK_BAUD / rate);
+	d.level = false;
+	d.last_sampled = false;
+	d.flag_reg = 0;
+	d.ones = 0;
+	d.in_frame = false;
+	d.frame_len = 0;
+	d.bit_count = 0;
+	d.cur_byte = 0;
+	d.sample = 0;
+	d.read = 0;
+	d.frames = 0;
+}
+
+static const float* push(float* hist, int& pos, int len, float x) {	// add a sample, return the window, oldest first
+	hist[pos] = x;
+	hist[pos + len] = x;
+	pos = pos + 1 == len ? 0 : pos + 1;
+	return hist + pos;
+}
+
+static inline void load(demod_floats& v, const float* p) {	// unaligned, the window moves a sample at a time
+	memcpy(&v, p, sizeof(v));
+}
+
+static inline float sum(const demod_floats& v) {
+	float total = 0;
+	for (int i=0;i<AFSK_VECTOR;i++) total += v[i];
+	return total;
+}
+
+static void frame_done(afsk_decoder& d) {		// a flag after some bytes: keep it if the FCS checks out
+	if (d.frame_len < 17) return;				// shorter than the smallest AX.25 frame and FCS
+	int len = d.frame_len - 2;
+	if (hdlc_fcs(d.frame, len) != (d.frame[len] | d.frame[len + 1] << 8)) return;
+	d.frames++;
+	afsk_demod& demod = *d.demod;
+	pthread_mutex_lock(&demod.lock);
+	if (demod.queue_len == DEMOD_QUEUE) {
+		demod.dropped++;
+	} else {
+		demod_frame& out = demod.queue[(demod.queue_head + demod.queue_len) % DEMOD_QUEUE];
+		out.len = len;
+		memcpy(out.data, d.frame, d.frame_len);
+		out.decoder = d.index;
+		out.sample = d.sample;
+		demod.queue_len++;
+	}
+	pthread_mutex_unlock(&demod.lock);
+	if (demod.event_fd != -1) {
+		uint64_t one = 1;
+		write(demod.event_fd, &one, sizeof(one));
+	}
+}
+
+static void hdlc_bit(afsk_decoder& d, int bit) {
+	d.flag_reg = d.flag_reg >> 1 | bit << 7;
+	if (d.flag_reg == HDLC_FLAG) {				// end of one frame and maybe the start of the next
+		if (d.in_frame) frame_done(d);
+		d.in_frame = true;
+		d.frame_len = 0;
+		d.bit_count = 0;
+		d.ones = 0;
+		return;
+	}
+	if (bit) {
+		if (++d.ones > 6) {						// seven 1s is an abort, or just noise
+			d.in_frame = false;
+			return;
+		}
+	} else {
+		bool stuffed = d.ones == 5;
+		d.ones = 0;
+		if (stuffed) return;					// the 0 after five 1s isn't data
+	}
+	if (!d.in_frame) return;
+	d.cur_byte = d.cur_byte >> 1 | bit << 7;	// least significant bit first
+	if (++d.bit_count == 8) {
+		if (d.frame_len == DEMOD_MAX_FRAME) {	// too long to be anything of ours
+			d.in_frame = false;
+			return;
+		}
+		d.frame[d.frame_len++] = d.cur_byte;
+		d.bit_count = 0;
+	}
+}
+
+static void decode(afsk_decoder& d, const float* samples, int count) {
+	for (int n=0;n<count;n++) {
+		float x = samples[n];
+		if (d.prefilter) {
+			const float* w = push(d.bp_hist, d.bp_pos, d.bp_taps, x);
+			demod_floats acc = {}, v, h;
+			for (int i=0;i<d.bp_taps;i+=AFSK_VECTOR) {
+				load(v, w + i);
+				load(h, d.bp + i);
+				acc += v * h;
+			}
+			x = sum(acc);
+		}
+		const float* w = push(d.hist, d.hist_pos, d.taps, x);
+		demod_floats mi = {}, mq = {}, si = {}, sq = {}, v, t[4];	// all four correlators in one pass over the window
+		for (int i=0;i<d.taps;i+=AFSK_VECTOR) {
+			load(v, w + i);
+			for (int k=0;k<4;k++) load(t[k], d.corr + k * d.taps + i);
+			mi += v * t[0];
+			mq += v * t[1];
+			si += v * t[2];
+			sq += v * t[3];
+		}
+		float a = sum(mi), b = sum(mq), c = sum(si), e = sum(sq);
+		bool level = a * a + b * b > d.space_gain * (c * c + e * e);	// true for mark
+
+		int before = d.pll;
+		d.pll = (int)((unsigned int)d.pll + (unsigned int)d.pll_step);
+		if (before > 0 && d.pll < 0) {					// middle of a bit
+			hdlc_bit(d, level == d.last_sampled);		// NRZI: no change is a 1
+			d.last_sampled = level;
+		}
+		if (level != d.level) {							// transitions should land on 0, pull towards it
+			d.pll = (int)(d.pll * 0.75f);
+			d.level = level;
+		}
+		d.sample++;
+	}
+}
+
+static void* decoder_thread(void* arg) {
+	afsk_decoder& d = *(afsk_decoder*)arg;
+	afsk_demod& demod = *d.demod;
+	pthread_mutex_lock(&demod.lock);
+	while (true) {
+		while (d.read == demod.written && !demod.eof) pthread_cond_wait(&demod.more, &demod.lock);
+		if (d.read == demod.written) break;				// eof and all done
+		int slot = d.read % DEMOD_BLOCKS;
+		int len = demod.block_len[slot];
+		pthread_mutex_unlock(&demod.lock);
+		decode(d, demod.blocks + slot * DEMOD_BLOCK, len);
+		pthread_mutex_lock(&demod.lock);
+		d.read++;
+		pthread_cond_broadcast(&demod.room);
+	}
+	demod.running--;
+	pthread_mutex_unlock(&demod.lock);
+	return NULL;
+}
+
+static bool read_full(int fd, void* out, int len) {
+	char* p = (char*)out;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n == -1 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool skip(int fd, unsigned int len) {
+	char buff[256];
+	while (len > 0) {
+		unsigned int n = len < sizeof(buff) ? len : sizeof(buff);
+		if (!read_full(fd, buff, n)) return false;
+		len -= n;
+	}
+	return true;
+}
+
+static unsigned int get_le(const unsigned char* p, int bytes) {
+	unsigned int value = 0;
+	for (int i=bytes-1;i>=0;i--) value = value << 8 | p[i];
+	return value;
+}
+
+static bool wav_open(afsk_demod& demod) {		// read up to the sample data, picking up the format on the way
+	unsigned char h[16];
+	if (!read_full(demod.fd, h, 12) || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) return false;
+	bool format = false;
+	while (read_full(demod.fd, h, 8)) {
+		unsigned int size = get_le(h + 4, 4);
+		if (memcmp(h, "data", 4) == 0) return format;
+		if (memcmp(h, "fmt ", 4) == 0 && size >= 16) {
+			if (!read_full(demod.fd, h, 16)) return false;
+			if (get_le(h, 2) != 1 || get_le(h + 14, 2) != 16) return false;	// 16 bit PCM only
+			demod.channels = get_le(h + 2, 2);
+			demod.sample_rate = get_le(h + 4, 4);
+			format = demod.channels > 0;
+			size -= 16;
+		}
+		if (!skip(demod.fd, size + (size & 1))) return false;	// chunks are padded to even sizes
+	}
+	return false;
+}
+
+static void* reader_thread(void* arg) {
+	afsk_demod& demod = *(afsk_demod*)arg;
+	int frame_bytes = 2 * demod.channels;
+	short raw[DEMOD_BLOCK * 2];
+	unsigned char* bytes = (unsigned char*)raw;
+	int have = 0;												// bytes of a partial sample frame left from the last read
+	while (true) {
+		pthread_mutex_lock(&demod.lock);
+		while (true) {											// wait for the slowest decoder to free a block
+			long long oldest = demod.written;
+			for (int i=0;i<demod.decoder_count;i++) {
+				if (demod.decoders[i].read < oldest) oldest = demod.decoders[i].read;
+			}
+			if (demod.written - oldest < DEMOD_BLOCKS) break;
+			pthread_cond_wait(&demod.room, &demod.lock);
+		}
+		pthread_mutex_unlock(&demod.lock);
+
+		int max = DEMOD_BLOCK / demod.channels * frame_bytes;	// whole sample frames that fit a block
+		if (max > (int)sizeof(raw)) max = sizeof(raw) / frame_bytes * frame_bytes;
+		ssize_t n = read(demod.fd, bytes + have, max - have);	// whatever is there, to keep latency down on live audio
+		if (n == -1 && errno == EINTR) continue;
+		if (n <= 0) break;
+		have += n;
+		int count = have / frame_bytes;
+		int slot = demod.written % DEMOD_BLOCKS;
+		float* block = demod.blocks + slot * DEMOD_BLOCK;
+		for (int i=0;i<count;i++) block[i] = (short)get_le(bytes + i * frame_bytes, 2) / 32768.0f;	// first channel
+		memmove(bytes, bytes + count * frame_bytes, have - count * frame_bytes);
+		have -= count * frame_bytes;
+		if (count == 0) continue;
+
+		pthread_mutex_lock(&demod.lock);
+		demod.block_len[slot] = count;
+		demod.written++;
+		demod.samples += count;
+		pthread_cond_broadcast(&demod.more);
+		pthread_mutex_unlock(&demod.lock);
+	}
+	pthread_mutex_lock(&demod.lock);
+	demod.eof = true;
+	pthread_cond_broadcast(&demod.more);
+	pthread_mutex_unlock(&demod.lock);
+	return NULL;
+}
+
+bool demod_open(afsk_demod& demod, const char* path, int sample_rate, int decoders, int event_fd) {
+	demod.sample_rate = sample_rate;
+	demod.channels = 1;
+	if (strcmp(path, "-") == 0) {
+		demod.fd = STDIN_FILENO;
+	} else {
+		demod.fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (demod.fd == -1) return false;
+		if (!wav_open(demod)) {
+			close(demod.fd);
+			errno = EINVAL;
+			return false;
+		}
+	}
+	if (demod.sample_rate < AFSK_SPACE * 2 || demod.sample_rate > AFSK_MAX_RATE || decoders < 1 || decoders > DEMOD_MAX_DECODERS) {
+		errno = EINVAL;
+		return false;
+	}
+
+	demod.blocks = floats(DEMOD_BLOCKS * DEMOD_BLOCK);
+	demod.written = 0;
+	demod.eof = false;
+	demod.queue = new demod_frame[DEMOD_QUEUE];
+	demod.queue_head = 0;
+	demod.queue_len = 0;
+	demod.event_fd = event_fd;
+	for (int i=0;i<DEMOD_RECENT;i++) demod.recent_sample[i] = -1;
+	demod.recent_pos = 0;
+	demod.frames = 0;
+	demod.duplicates = 0;
+	demod.dropped = 0;
+	demod.samples = 0;
+	pthread_mutex_init(&demod.lock, NULL);
+	pthread_cond_init(&demod.more, NULL);
+	pthread_cond_init(&demod.room, NULL);
+
+	demod.decoders = new afsk_decoder[decoders];
+	demod.decoder_count = decoders;
+	demod.running = decoders;
+	for (int i=0;i<decoders;i++) decoder_init(demod.decoders[i], demod, i);
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for (int i=0;i<decoders;i++) {
+		pthread_create(&demod.decoders[i].thread, NULL, &decoder_thread, &demod.decoders[i]);
+		if (cpus > 1) {											// a core each, leaving the first to the reader and main loop
+			cpu_set_t cpu;
+			CPU_ZERO(&cpu);
+			CPU_SET((i + 1) % cpus, &cpu);
+			pthread_setaffinity_np(demod.decoders[i].thread, sizeof(cpu), &cpu);
+		}
+	}
+	pthread_create(&demod.reader, NULL, &reader_thread, &demod);
+	return true;
+}	// END OF 'demod_open'
+
+bool demod_next(afsk_demod& demod, demod_frame& frame) {
+	while (true) {
+		pthread_mutex_lock(&demod.lock);
+		bool got = demod.queue_len > 0;
+		if (got) {
+			frame = demod.queue[demod.queue_head];
+			demod.queue_head = (demod.queue_head + 1) % DEMOD_QUEUE;
+			demod.queue_len--;
+		}
+		pthread_mutex_unlock(&demod.lock);
+		if (!got) return false;
+
+		unsigned int key = hdlc_fcs(frame.data, frame.len) << 16 | frame.len;	// the same frame from another decoder ends within a few bits
+		bool duplicate = false;
+		for (int i=0;i<DEMOD_RECENT;i++) {
+			if (demod.recent_sample[i] != -1 && demod.recent_key[i] == key && llabs(frame.sample - demod.recent_sample[i]) < demod.sample_rate / 20) duplicate = true;
+		}
+		if (duplicate) {
+			demod.duplicates++;
+			continue;
+		}
+		demod.recent_key[demod.recent_pos] = key;
+		demod.recent_sample[demod.recent_pos] = frame.sample;
+		demod.recent_pos = (demod.recent_pos + 1) % DEMOD_RECENT;
+		demod.frames++;
+		return true;
+	}
+}	// END OF 'demod_next'
+
+void demod_wait(afsk_demod& demod) {
+	pthread_join(demod.reader, NULL);
+	for (int i=0;i<demod.decoder_count;i++) pthread_join(demod.decoders[i].thread, NULL);
+}	// END OF 'demod_wait'
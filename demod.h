@@ -0,0 +1,108 @@
+// Bell 202 AFSK demodulator, several decoders in parallel, the receive half of a soft TNC.
+
+#ifndef __DEMOD_H__
+#define __DEMOD_H__
+
+#include <pthread.h>
+#include "ax25.h"
+
+#define DEMOD_MAX_DECODERS 8
+#define DEMOD_BLOCK 4096		// samples per block handed from the reader to the decoders
+#define DEMOD_BLOCKS 16			// blocks in flight, the slowest decoder holds the reader back
+#define DEMOD_QUEUE 64			// decoded frames waiting for the caller
+#define DEMOD_RECENT 32			// frames remembered to spot the same one from another decoder
+#define DEMOD_MAX_FRAME (AX25_MAX_HEADER + AX25_MAX_INFO + 2)	// FCS included
+
+struct demod_frame {
+	int len;					// without the FCS
+	unsigned char data[DEMOD_MAX_FRAME];
+	int decoder;				// which one got it first
+	long long sample;			// where it ended
+};
+
+struct afsk_demod;
+
+// One decoder: an optional band pass prefilter, mark and space correlators
+// (I and Q each) one bit long, a slicer comparing mark energy with weighted
+// space energy, a DPLL for the bit clock, NRZI and an HDLC deframer that
+// checks the FCS. Decoders differ in their prefilter and slicer weight so
+// that between them they cope with more kinds of audio (flat, de-emphasized,
+// pre-emphasized) than any one would. FIR dot products are done with GCC
+// vector extensions.
+struct afsk_decoder {
+	afsk_demod* demod;
+	int index;
+	pthread_t thread;
+	bool prefilter;				// band pass the audio first
+	float space_gain;			// slicer weight on the space tone, > 1 for audio that lost its highs
+	int taps;					// correlator length, padded to the vector width
+	float* corr;				// mark cos, mark sin, space cos, space sin, 'taps' each
+	float* hist;				// sample history, written twice so the window is always contiguous
+	int hist_pos;
+	int bp_taps;
+	float* bp;					// band pass taps
+	float* bp_hist;
+	int bp_pos;
+	int pll;					// bit clock, a bit is sampled as it wraps past 2^31
+	int pll_step;
+	bool level;					// slicer output, mark or space
+	bool last_sampled;			// level at the last bit, for NRZI
+	unsigned char flag_reg;		// last 8 bits, to spot flags
+	int ones;					// 1 bits in a row, for unstuffing
+	bool in_frame;
+	unsigned char frame[DEMOD_MAX_FRAME];
+	int frame_len;
+	int bit_count;				// bits in cur_byte
+	unsigned char cur_byte;
+	long long sample;			// samples processed
+	long long read;				// blocks processed
+	unsigned long frames;		// good frames decoded, duplicates included
+};
+
+// A reader thread pulls PCM from a file descriptor into a ring of blocks
+// and every decoder thread runs over every block, each on its own core where
+// there are enough. Decoded frames are queued for the caller, who gets
+// poked through 'event_fd' (an eventfd, or -1) and takes them with
+// demod_next(), which drops copies of a frame found by more than one
+// decoder.
+struct afsk_demod {
+	int sample_rate;
+	int fd;
+	int channels;				// in the input, only the first is used
+	float* blocks;				// DEMOD_BLOCKS * DEMOD_BLOCK
+	int block_len[DEMOD_BLOCKS];
+	long long written;			// blocks read in so far
+	bool eof;
+	int running;				// decoders still going
+	pthread_mutex_t lock;
+	pthread_cond_t more;		// a block was written, or eof
+	pthread_cond_t room;		// a block was finished by every decoder
+	pthread_t reader;
+	afsk_decoder* decoders;
+	int decoder_count;
+	demod_frame* queue;
+	int queue_head;
+	int queue_len;
+	int event_fd;
+	unsigned int recent_key[DEMOD_RECENT];	// FCS and length of recent frames
+	long long recent_sample[DEMOD_RECENT];
+	int recent_pos;
+	unsigned long frames;		// frames handed out
+	unsigned long duplicates;	// the same frame from another decoder
+	unsigned long dropped;		// the queue was full
+	long long samples;			// read from the input
+};
+
+// Open 'path' (a WAV file, or "-" for raw 16 bit mono PCM on stdin at
+// 'sample_rate') and start 'decoders' decoders on it. A WAV file's own rate
+// wins. Returns false with errno set if the input can't be used.
+bool demod_open(afsk_demod& demod, const char* path, int sample_rate, int decoders, int event_fd);
+
+// Take the next decoded frame that isn't a duplicate. Returns false if none
+// are waiting.
+bool demod_next(afsk_demod& demod, demod_frame& frame);
+
+// Wait until all input has been decoded (for files, the end of it).
+void demod_wait(afsk_demod& demod);
+
+#endif  // __DEMOD_H__
@@ -0,0 +1,68 @@
+// WIDEn-N / alias digipeater working directly on received frames.
+
+#include <cstring>
+#include "digi.h"
+
+#define HBIT 0x80				// has-been-repeated bit of a via ssid byte
+#define SSID_MASK 0x1E			// ssid bits of an ssid byte
+
+static bool same_address(const unsigned char* a, const unsigned char* b) {	// same callsign and ssid, whatever the flag bits
+	return memcmp(a, b, 6) == 0 && (a[6] & SSID_MASK) == (b[6] & SSID_MASK);
+}
+
+static int wide_n(const unsigned char* addr) {	// n of a WIDEn-N address, or 0 if it isn't one
+	if (addr[0] != 'W' << 1 || addr[1] != 'I' << 1 || addr[2] != 'D' << 1 || addr[3] != 'E' << 1 || addr[5] != ' ' << 1) return 0;
+	int n = (addr[4] >> 1) - '0';
+	return n >= 1 && n <= 7 ? n : 0;
+}
+
+int digi_process(const digi_config& digi, unsigned char* data, int len, const ax25_frame& frame, unsigned char* out) {
+	if (!digi.enable || same_address(frame.source, digi.mycall)) return 0;	// never repeat ourselves
+
+	int next = 0;
+	while (next < frame.digis && (frame.via[next][6] & HBIT)) next++;	// first via that hasn't been used yet
+	if (next == frame.digis) return 0;
+	unsigned char* via = data + (frame.via[next] - frame.destination);
+	bool alias = false;									// swap the via for our call
+	bool insert = false;
+	unsigned char ssid;									// the via's new ssid byte
+
+	if (same_address(via, digi.mycall)) {				// addressed to us directly
+		ssid = via[6] | HBIT;
+	} else {
+		int i = 0;
+		while (i < digi.alias_count && !same_address(via, digi.aliases[i])) i++;
+		if (i < digi.alias_count) {						// an alias, answer with our own call
+			alias = true;
+			ssid = (via[6] & ~SSID_MASK) | (digi.mycall[6] & SSID_MASK) | HBIT;
+		} else {
+			int n = wide_n(via);
+			int hops = (via[6] & SSID_MASK) >> 1;
+			if (n == 0 || n > digi.max_hops || hops == 0 || hops > n) return 0;	// not ours, or an abusive path
+			hops--;
+			ssid = (via[6] & ~SSID_MASK) | (hops << 1);
+			if (hops == 0) ssid |= HBIT;
+			insert = digi.trace && frame.digis < AX25_MAX_DIGIS;
+		}
+	}
+
+	if (len + (insert ? AX25_ADDR_LEN : 0) > AX25_MAX_HEADER + AX25_MAX_INFO) return 0;	// too big to fit our buffers
+	if (alias) memcpy(via, digi.mycall, 6);				// it goes out, so only now touch the frame
+	via[6] = ssid;
+	unsigned char* p = out;
+	*p++ = KISS_FEND;
+	*p++ = 0x00;
+	if (insert) {										// escape around the gap instead of moving the frame
+		int split = via - data;
+		unsigned char mine[AX25_ADDR_LEN];
+		memcpy(mine, digi.mycall, AX25_ADDR_LEN);
+		mine[6] = (mine[6] & SSID_MASK) | 0x60 | HBIT;	// repeated, and never the last address
+		p = kiss_escape(p, data, split);
+		p = kiss_escape(p, mine, AX25_ADDR_LEN);
+		p = kiss_escape(p, via, len - split);
+	} else {
+		p = kiss_escape(p, data, len);
+	}
+	*p++ = KISS_FEND;
+	return p - out;
+}	// END OF 'digi_process'
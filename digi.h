@@ -0,0 +1,27 @@
+// WIDEn-N / alias digipeater working directly on received frames.
+
+#ifndef __DIGI_H__
+#define __DIGI_H__
+
+#include "ax25.h"
+
+#define DIGI_MAX_ALIASES 8
+
+struct digi_config {
+	bool enable;
+	unsigned char mycall[AX25_ADDR_LEN];	// our own address
+	unsigned char aliases[DIGI_MAX_ALIASES][AX25_ADDR_LEN];	// exact matches we answer to (e.g. WIDE1-1 fill-in), replaced by our call
+	int alias_count;
+	int max_hops;				// largest n of WIDEn-N we repeat
+	bool trace;					// insert our call in front of a WIDEn-N we repeat
+};
+
+// Decide whether to repeat 'data' (a raw AX.25 frame, 'frame' is what
+// ax25_parse() made of it) and if so write the KISS frame to send into 'out'
+// (room for KISS_MAX_FRAME bytes). The address field is patched where it
+// lies in 'data': the next unused via gets its H bit set or its SSID
+// decremented, or is swapped for our call. Returns the KISS frame length, or
+// 0 if the frame isn't for us to repeat, in which case 'data' is untouched.
+int digi_process(const digi_config& digi, unsigned char* data, int len, const ax25_frame& frame, unsigned char* out);
+
+#endif  // __DIGI_H__
@@ -0,0 +1,94 @@
+// Duplicate packet filter with a sliding time window.
+
+#include "dupe.h"
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL	// 64 bit FNV-1a
+#define FNV_PRIME 0x100000001B3ULL
+
+static unsigned long long fnv(unsigned long long hash, const unsigned char* data, int len) {
+	for (int i=0;i<len;i++) {
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static int slot_of(const dupe_filter& filter, unsigned long long key) {	// home slot, from the well mixed high bits
+	return (key >> 32 ^ key) & filter.mask;
+}
+
+static void remove_key(dupe_filter& filter, unsigned long long key) {
+	int i = slot_of(filter, key);
+	while (filter.keys[i] != key) {
+		if (filter.keys[i] == 0) return;		// already gone
+		i = (i + 1) & filter.mask;
+	}
+	int j = i;
+	while (true) {								// shift later entries back into the hole so no probe chain breaks
+		j = (j + 1) & filter.mask;
+		if (filter.keys[j] == 0) break;
+		int home = slot_of(filter, filter.keys[j]);
+		if (((j - home) & filter.mask) >= ((j - i) & filter.mask)) {	// j's home isn't between the hole and j, it can move
+			filter.keys[i] = filter.keys[j];
+			i = j;
+		}
+	}
+	filter.keys[i] = 0;
+}
+
+static void expire_oldest(dupe_filter& filter) {
+	remove_key(filter, filter.ring_keys[filter.ring_head]);
+	filter.ring_head = (filter.ring_head + 1) % filter.ring_size;
+	filter.ring_len--;
+}
+
+void dupe_init(dupe_filter& filter, int entries, int window) {
+	int size = 1;
+	while (size < entries * 2) size <<= 1;		// keep the table at most half full
+	filter.keys = new unsigned long long[size];
+	for (int i=0;i<size;i++) filter.keys[i] = 0;
+	filter.mask = size - 1;
+	filter.ring_keys = new unsigned long long[entries];
+	filter.ring_times = new long long[entries];
+	filter.ring_size = entries;
+	filter.ring_head = 0;
+	filter.ring_len = 0;
+	filter.window = window * 1000LL;
+	filter.dupes = 0;
+	filter.evicted = 0;
+}	// END OF 'dupe_init'
+
+unsigned long long dupe_key(const unsigned char* destination, const unsigned char* source, const unsigned char* info, int info_len) {
+	unsigned char ssids[2] = {(unsigned char)(destination[6] & 0x1E), (unsigned char)(source[6] & 0x1E)};
+	unsigned long long key = fnv(FNV_OFFSET, destination, 6);
+	key = fnv(key, source, 6);
+	key = fnv(key, ssids, 2);
+	key = fnv(key, info, info_len);
+	return key ? key : 1;						// 0 means an empty slot
+}	// END OF 'dupe_key'
+
+bool dupe_check(dupe_filter& filter, unsigned long long key, long long now) {
+	while (filter.ring_len > 0 && filter.ring_times[filter.ring_head] <= now - filter.window) expire_oldest(filter);
+
+	int i = slot_of(filter, key);
+	while (filter.keys[i] != 0) {
+		if (filter.keys[i] == key) {
+			filter.dupes++;
+			return true;
+		}
+		i = (i + 1) & filter.mask;
+	}
+
+	if (filter.ring_len == filter.ring_size) {	// full, make room by forgetting the oldest early
+		expire_oldest(filter);
+		filter.evicted++;
+		i = slot_of(filter, key);				// the hole may have moved our slot
+		while (filter.keys[i] != 0) i = (i + 1) & filter.mask;
+	}
+	filter.keys[i] = key;
+	int tail = (filter.ring_head + filter.ring_len) % filter.ring_size;
+	filter.ring_keys[tail] = key;
+	filter.ring_times[tail] = now;
+	filter.ring_len++;
+	return false;
+}	// END OF 'dupe_check'
@@ -0,0 +1,37 @@
+// Duplicate packet filter with a sliding time window.
+
+#ifndef __DUPE_H__
+#define __DUPE_H__
+
+#define DUPE_WINDOW 30			// seconds, the usual APRS dupe window
+
+// Packets are reduced to a 64 bit key and kept in an open addressing
+// (linear probing) table with a FIFO ring recording the order they went in.
+// Since that order is also time order, expiring old keys only ever looks at
+// the front of the ring, and the table is never scanned. Both are sized once
+// by dupe_init(); if the ring fills up, the oldest key is dropped early.
+struct dupe_filter {
+	unsigned long long* keys;	// hash table, 0 marks an empty slot
+	int mask;					// table size - 1, the size is a power of two
+	unsigned long long* ring_keys;	// keys in the order they were added
+	long long* ring_times;		// and when, in ms
+	int ring_size;
+	int ring_head;
+	int ring_len;
+	long long window;			// ms
+	unsigned long dupes;		// packets caught
+	unsigned long evicted;		// keys dropped before their window was up
+};
+
+// Allocate room for 'entries' packets within a window of 'window' seconds.
+void dupe_init(dupe_filter& filter, int entries, int window);
+
+// The key of a packet: destination and source callsign and SSID (ignoring
+// the flag bits) and the info field. The path doesn't count.
+unsigned long long dupe_key(const unsigned char* destination, const unsigned char* source, const unsigned char* info, int info_len);
+
+// Returns true if 'key' was already seen within the window. Otherwise
+// remembers it (as of 'now', in ms) and returns false.
+bool dupe_check(dupe_filter& filter, unsigned long long key, long long now);
+
+#endif  // __DUPE_H__
@@ -0,0 +1,67 @@
+// Position/velocity fix shared between the GPS thread and the beacon code.
+
+#ifndef __FIX_H__
+#define __FIX_H__
+
+#include <atomic>
+#include <cstring>
+#include <time.h>
+#include <type_traits>
+
+struct gps_fix {				// everything we know from one fix, copied around as a whole
+	bool valid;					// the receiver has a fix, ok to send beacons
+	bool warm;					// actually the last fix from before a restart, until the receiver has one
+	long lat;					// latitude, micro-degrees, negative for S
+	long lon;					// longitude, micro-degrees, negative for W
+	int speed;					// speed, in hundredths of a knot
+	int hdg;					// heading, in degrees
+	struct tm time;				// time of the fix
+	unsigned long count;		// fixes published so far
+	long long heard;			// when it came in, on the monotonic clock in ms, 0 if not this run
+};
+
+// A sequence lock for one writer and any number of readers. The writer never
+// waits, and readers never block it: they copy the value and retry if the
+// writer got in the way, so they always see a value from a single store().
+// The value is kept in relaxed atomic words so that the racing copy is well
+// defined.
+template <typename T>
+class seqlock {
+	static_assert(std::is_trivially_copyable<T>::value, "seqlock values are copied bytewise");
+
+public:
+	seqlock() : seq(0) {
+		for (int i=0;i<WORDS;i++) data[i].store(0, std::memory_order_relaxed);
+	}
+
+	void store(const T& value) {		// only ever call this from one thread
+		unsigned long words[WORDS] = {0};
+		memcpy(words, &value, sizeof(T));
+		unsigned long s = seq.load(std::memory_order_relaxed);
+		seq.store(s + 1, std::memory_order_relaxed);		// odd: write in progress
+		std::atomic_thread_fence(std::memory_order_release);
+		for (int i=0;i<WORDS;i++) data[i].store(words[i], std::memory_order_relaxed);
+		seq.store(s + 2, std::memory_order_release);		// even again: done
+	}
+
+	T load() const {
+		unsigned long words[WORDS];
+		unsigned long before, after;
+		do {
+			before = seq.load(std::memory_order_acquire);
+			for (int i=0;i<WORDS;i++) words[i] = data[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = seq.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);			// torn by a store(), go again
+		T value;
+		memcpy(&value, words, sizeof(T));
+		return value;
+	}
+
+private:
+	static const int WORDS = (sizeof(T) + sizeof(unsigned long) - 1) / sizeof(unsigned long);
+	std::atomic<unsigned long> seq;
+	std::atomic<unsigned long> data[WORDS];
+};
+
+#endif  // __FIX_H__
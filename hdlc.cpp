@@ -0,0 +1,54 @@
+// AX.25 HDLC framing: flags, bit stuffing, FCS and NRZI, for the soft TNC.
+
+#include "hdlc.h"
+
+struct fcs_table {				// reflected CRC-16/X.25 (polynomial 0x8408), a byte at a time
+	unsigned short crc[256];
+	constexpr fcs_table() : crc() {
+		for (int i=0;i<256;i++) {
+			unsigned short c = i;
+			for (int b=0;b<8;b++) c = (c & 1) ? (c >> 1) ^ 0x8408 : c >> 1;
+			crc[i] = c;
+		}
+	}
+};
+static constexpr fcs_table FCS_TABLE;
+
+unsigned short hdlc_fcs(const unsigned char* data, int len) {
+	unsigned short crc = 0xFFFF;
+	for (int i=0;i<len;i++) crc = (crc >> 8) ^ FCS_TABLE.crc[(crc ^ data[i]) & 0xFF];
+	return crc ^ 0xFFFF;
+}	// END OF 'hdlc_fcs'
+
+static unsigned char* put_bit(unsigned char& tone, unsigned char* out, int bit) {	// NRZI
+	if (bit == 0) tone ^= 1;
+	*out++ = tone;
+	return out;
+}
+
+static unsigned char* put_flags(unsigned char& tone, unsigned char* out, int count) {	// never stuffed
+	for (int i=0;i<count;i++) {
+		for (int b=0;b<8;b++) out = put_bit(tone, out, (HDLC_FLAG >> b) & 1);
+	}
+	return out;
+}
+
+int hdlc_encode(unsigned char& tone, unsigned char* out, const unsigned char* frame, int len, int flags_before, int flags_after) {
+	unsigned char* p = put_flags(tone, out, flags_before);
+	unsigned short fcs = hdlc_fcs(frame, len);
+	int ones = 0;
+	for (int i=0;i<len+2;i++) {
+		unsigned char c = i < len ? frame[i] : (i == len ? fcs & 0xFF : fcs >> 8);
+		for (int b=0;b<8;b++) {				// least significant bit first
+			int bit = (c >> b) & 1;
+			p = put_bit(tone, p, bit);
+			ones = bit ? ones + 1 : 0;
+			if (ones == 5) {				// so the data never looks like a flag
+				p = put_bit(tone, p, 0);
+				ones = 0;
+			}
+		}
+	}
+	p = put_flags(tone, p, flags_after);
+	return p - out;
+}	// END OF 'hdlc_encode'
@@ -0,0 +1,20 @@
+// AX.25 HDLC framing: flags, bit stuffing, FCS and NRZI, for the soft TNC.
+
+#ifndef __HDLC_H__
+#define __HDLC_H__
+
+#define HDLC_FLAG 0x7E
+#define HDLC_MAX_BITS(len, flags) (((len) + 2) * 8 * 6 / 5 + 8 * (flags) + 8)	// worst case stuffing, FCS and flags
+
+// CRC-16/X.25 of an AX.25 frame, sent low byte first after it.
+unsigned short hdlc_fcs(const unsigned char* data, int len);
+
+// NRZI encode a frame into tones, one byte per bit (1 mark, 0 space): a 0 bit
+// changes the tone, a 1 keeps it. 'tone' carries the line state from one
+// frame to the next. The frame gets 'flags_before' and 'flags_after' flags
+// around it, its FCS, and a 0 stuffed after every five 1s in between.
+// 'out' needs HDLC_MAX_BITS(len, flags_before + flags_after) bytes. Returns
+// the number of bits.
+int hdlc_encode(unsigned char& tone, unsigned char* out, const unsigned char* frame, int len, int flags_before, int flags_after);
+
+#endif  // __HDLC_H__
@@ -0,0 +1,75 @@
+// Streaming KISS deframer for data coming back from a TNC.
+
+#include <cstring>
+#include <unistd.h>
+#include "ax25.h"
+#include "kiss.h"
+
+void kiss_deframer_init(kiss_deframer& kiss) {
+	kiss.fill = 0;
+	kiss.scan = 0;
+	kiss.start = 0;
+	kiss.out = 0;
+	kiss.escape = false;
+	kiss.synced = false;
+	kiss.oversize = false;
+	kiss.frames = 0;
+	kiss.errors = 0;
+}	// END OF 'kiss_deframer_init'
+
+int kiss_read(kiss_deframer& kiss, int fd) {
+	int n = read(fd, kiss.buf + kiss.fill, KISS_BUFFER_SIZE - kiss.fill);
+	if (n > 0) kiss.fill += n;
+	return n;
+}	// END OF 'kiss_read'
+
+int kiss_feed(kiss_deframer& kiss, const unsigned char* data, int len) {
+	if (len > KISS_BUFFER_SIZE - kiss.fill) len = KISS_BUFFER_SIZE - kiss.fill;
+	memcpy(kiss.buf + kiss.fill, data, len);
+	kiss.fill += len;
+	return len;
+}	// END OF 'kiss_feed'
+
+bool kiss_next(kiss_deframer& kiss, unsigned char*& frame, int& len) {
+	while (kiss.scan < kiss.fill) {
+		unsigned char c = kiss.buf[kiss.scan++];
+		if (c == KISS_FEND) {					// end of one frame, start of the next
+			int frame_start = kiss.start;
+			int frame_len = kiss.out - kiss.start;
+			bool keep = kiss.synced && !kiss.oversize && frame_len > 0;
+			kiss.start = kiss.out = kiss.scan;
+			kiss.escape = false;
+			kiss.synced = true;
+			kiss.oversize = false;
+			if (keep) {
+				frame = kiss.buf + frame_start;
+				len = frame_len;
+				kiss.frames++;
+				return true;
+			}
+			continue;
+		}
+		if (!kiss.synced || kiss.oversize) continue;	// junk before the first FEND, or a frame we gave up on
+		if (kiss.escape) {
+			kiss.escape = false;
+			if (c == KISS_TFEND) c = KISS_FEND;
+			else if (c == KISS_TFESC) c = KISS_FESC;
+			else kiss.errors++;					// not a valid escape, pass it through like the spec says
+		} else if (c == KISS_FESC) {
+			kiss.escape = true;
+			continue;
+		}
+		if (kiss.out - kiss.start >= KISS_MAX_RAW) {
+			kiss.oversize = true;
+			kiss.errors++;
+			continue;
+		}
+		kiss.buf[kiss.out++] = c;
+	}
+
+	int partial = kiss.out - kiss.start;		// everything's scanned, keep just the partial frame
+	if (partial > 0 && kiss.start > 0) memmove(kiss.buf, kiss.buf + kiss.start, partial);
+	kiss.start = 0;
+	kiss.out = kiss.scan = kiss.fill = partial;
+	return false;
+}	// END OF 'kiss_next'
@@ -0,0 +1,41 @@
+// Streaming KISS deframer for data coming back from a TNC.
+
+#ifndef __KISS_H__
+#define __KISS_H__
+
+#define KISS_BUFFER_SIZE 4096	// read buffer, several frames per read()
+#define KISS_MAX_RAW 1024		// frames bigger than this after unescaping are junk and get dropped
+
+// Raw bytes are appended to 'buf' and unescaped in place: the unescaped
+// output never gets ahead of the raw input, so it can share the buffer. A
+// returned frame points into 'buf' and stays valid until the next call on
+// the deframer; only the trailing partial frame is ever moved.
+struct kiss_deframer {
+	unsigned char buf[KISS_BUFFER_SIZE];
+	int fill;					// bytes in buf
+	int scan;					// next raw byte to look at
+	int start;					// start of the frame being unescaped
+	int out;					// where its next unescaped byte goes
+	bool escape;				// the last byte was FESC
+	bool synced;				// seen a FEND, so we're lined up on frame boundaries
+	bool oversize;				// the current frame got too big, drop it
+	unsigned long frames;		// frames returned
+	unsigned long errors;		// bad escapes and oversize frames
+};
+
+void kiss_deframer_init(kiss_deframer& kiss);
+
+// Read whatever is waiting on 'fd' into the deframer with one read() call and
+// return its result.
+int kiss_read(kiss_deframer& kiss, int fd);
+
+// Append 'len' bytes that came from somewhere other than a fd. Returns how
+// many fit; call kiss_next() until it returns false and feed the rest.
+int kiss_feed(kiss_deframer& kiss, const unsigned char* data, int len);
+
+// Get the next complete frame. frame[0] is the KISS port/command byte, the
+// rest is the unescaped AX.25 frame, which the caller may modify in place.
+// Returns false once only a partial frame is left.
+bool kiss_next(kiss_deframer& kiss, unsigned char*& frame, int& len);
+
+#endif  // __KISS_H__
@@ -5,126 +5,169 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <fcntl.h>
-#include <termios.h>
 #include <errno.h>
 #include <signal.h>
 #include <time.h>
 #include <cmath>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 //#include <hamlib/rig.h>	TODO: rig control
-#include "INIReader.cpp"
+#include "INIReader.h"
+#include "serial.h"
+#include "trace.h"
+#include "metrics.h"
+#include "ax25.h"
+#include "kiss.h"
+#include "digi.h"
+#include "dupe.h"
+#include "txq.h"
+#include "channel.h"
+#include "hdlc.h"
+#include "afsk.h"
+#include "demod.h"
+#include "mux.h"
+#include "nmea.h"
+#include "fix.h"
+#include "smartbeacon.h"
+#include "aprs.h"
+#include "stations.h"
+#include "tracklog.h"
+#include "warmstart.h"
+#include "wheel.h"
+#include "objects.h"
+#include "beacon.h"
 
 // DEFINES GO HERE
 #define VERSION "0.1"				// program version for messages, etc
-#define PACKET_DEST "APMGT1"		// packet tocall
 
 using namespace std;
 
 // GLOBAL VARS GO HERE
 string mycall;						// callsign we're operating under, excluding ssid
 char myssid;						// ssid of this station (stored as a number, not ascii)
-bool compress_pos;					// should we compress the aprs packet?
-string symbol_table;				// which symbol table to use
-string symbol_char;					// which symbol to use from the table
-int sb_low_speed;					// SmartBeaconing low threshold, in mph
-int sb_low_rate;					// SmartBeaconing low rate
-int sb_high_speed;					// SmartBeaconing high threshold, in mph
-int sb_high_rate;					// SmartBeaconing high rate
-int sb_turn_min;					// SmartBeaconing turn minimum
-int sb_turn_time;					// SmartBeaconing turn time (minimum)
-int sb_turn_slope;					// SmartBeaconing turn slope
+beacon_config beacon;				// format, symbol, comment and address field of our own position reports
+smartbeacon sb;						// SmartBeaconing settings and state
 bool verbose = false;				// did the user ask for verbose mode?
 bool gps_debug = false;				// did the user ask for gps debug info?
 bool tnc_debug = false;				// did the user ask for tnc debug info?
 bool sb_debug = false;				// did the user ask for smartbeaconing info?
-int kiss_iface = -1;				// tnc serial port fd
-int gps_iface = -1;					// gps serial port fd
-bool beacon_ok = false;				// should we be sending beacons?
-float pos_lat;						// current latitude
-string pos_lat_dir;					// latitude direction
-float pos_long;						// current longitude
-string pos_long_dir;				// current longitude direction
-struct tm * gps_time = new tm;		// last time received from the gps (if enabled)
-float gps_speed;					// speed from gps, in knots
-int gps_hdg;						// heading from gps
-int static_beacon_rate;				// how often (in seconds) to send a beacon if not using gps, set to 0 for SmartBeaconing
-string beacon_comment;				// comment to send along with aprs packets
-vector<string> path_calls;			// path callsigns
-vector<char> path_ssids;			// path ssids
+tnc_port tncs[MUX_MAX_PORTS];		// tnc serial ports, non-blocking, owned by the event loop; ours go out the first one
+int tnc_count = 0;
+serial_port gps_iface = {-1};		// gps serial port, blocking, read by gps_thread
+int fix_event = -1;					// eventfd, bumped by gps_thread every time it publishes a fix
+digi_config digi;					// digipeater settings
+dupe_filter dupes;					// packets heard or sent recently, shared by the receive and send paths
+station_db stations;				// everyone heard lately, and where they are
+tracklog track;						// fixes and beacons, if [tracklog] has a file
+int track_sync;						// seconds between forcing the track log out to the file
+warmstart warm;						// last fix saved across restarts, if [warmstart] has a file
+int warm_max_age;					// seconds a saved fix is still good for a first beacon
+channel_load channel;				// how busy the first tnc's channel is, heard and sent
+kiss_mux mux;						// local programs sharing the tncs over KISS
+int server_clients;					// most of them at once
+int server_tcp = -1;				// listening sockets for them, -1 if not configured
+int server_unix = -1;
+string server_unix_path;
+seqlock<gps_fix> current_fix;		// latest position, speed, heading and time, published by gps_thread
+object_list objects;				// objects and items to beacon alongside our own position
+int objects_burst;					// most object reports to send per second
+string metrics_file;				// Prometheus text file to keep up to date, blank for none
+metric_counter nmea_parsed;			// sentences from the gps that passed the checksum
+metric_counter nmea_rejected;		// and the ones that didn't
+metric_counter beacon_reasons[3];	// beacons sent, by sb_reason
+metric_histogram fix_age_ms;		// how old the fix was when a beacon went out
+metric_histogram pos_report_ns;		// time to encode and queue a beacon
+metric_histogram kiss_frame_ns;		// time to encode and queue any frame
+metric_histogram serial_write_ns;	// time spent writing a batch to a tnc
 
 // BEGIN FUNCTIONS
-void find_and_replace(string& subject, const string& search, const string& replace) {	// find and replace in a string, thanks Czarek Tomczak
-	size_t pos = 0;
-	while((pos = subject.find(search, pos)) != string::npos) {
-		subject.replace(pos, search.length(), replace);
-		pos += replace.length();
-	}
-}
-
-int get_baud(int baudint) {		// return a baudrate code from the baudrate int
-	switch (baudint) {
-	case 0:
-		return B0;
-	case 50:
-		return B50;
-	case 75:
-		return B75;
-	case 100:
-		return B110;
-	case 134:
-		return B134;
-	case 150:
-		return B150;
-	case 200:
-		return B200;
-	case 300:
-		return B300;
-	case 600:
-		return B600;
-	case 1200:
-		return B1200;
-	case 1800:
-		return B1800;
-	case 2400:
-		return B2400;
-	case 4800:
-		return B4800;
-	case 9600:
-		return B9600;
-	case 19200:
-		return B19200;
-	case 38400:
-		return B38400;
-	case 57600:
-		return B57600;
-	case 115200:
-		return B115200;
-	case 230400:
-		return B230400;
-	default:
-		return -1;
-	}
-}	// END OF 'get_baud'
-
-int open_port(string port, int baud_code) {					// open a serial port
-	struct termios options;
-	int iface = open(port.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);	// open the port
-	if (iface == -1) return -1;								// failed to open port
-	tcgetattr(iface, &options);								// get current control options for the port
-	cfsetispeed(&options, baud_code);						// set in baud rate
-	cfsetospeed(&options, baud_code);						// set out baud rate
-	options.c_cflag &= ~PARENB;								// no parity
-	options.c_cflag &= ~CSTOPB;								// 1 stop bit
-	options.c_cflag &= ~CSIZE;								// turn off 'csize'
-	options.c_cflag |= CS8;									// 8 bit data
-	options.c_cflag |= (CLOCAL | CREAD);					// enable the receiver and set local mode
-	options.c_lflag = ICANON;								// canonical mode
-	options.c_oflag &= ~OPOST;								// raw output
-	tcsetattr(iface, TCSANOW, &options);					// set the new options for the port
-	fcntl(iface, F_SETFL, 0);							// set port to nonblocking reads
-	tcflush(iface, TCIOFLUSH);								// flush buffer
-	return iface;											// return the file number
-}	// END OF 'open_port'
+long long monotonic_ms() {		// milliseconds on a clock that never jumps
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}	// END OF 'monotonic_ms'
+
+long long monotonic_ns() {		// the same, in nanoseconds, for timing things
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}	// END OF 'monotonic_ns'
+
+void open_tnc(INIReader& readconfig, tnc_port& tnc, const string& section) {		// open one tnc from its config section, or bail out
+	string type = readconfig.Get(section, "type", "serial");		// or afsk, for the built in soft tnc
+	string port = readconfig.Get(section, "port", "/dev/ttyS0");
+	int baud = readconfig.GetInteger(section, "baud", 9600);
+	tnc.radio_baud = readconfig.GetInteger(section, "radio_baud", 1200);	// on the air, for airtime
+	int airtime_percent = readconfig.GetInteger(section, "airtime_percent", 50);	// most of the channel we may use, 100 for no limit
+	int airtime_window = readconfig.GetInteger(section, "airtime_window", 60);		// averaged over this many seconds
+
+	if (serial_baud_code(baud) == -1) {		// that's an invalid baud rate
+		fprintf(stderr, "Invalid KISS baud rate %i\n", baud);
+		exit (EXIT_FAILURE);
+	}
+	if (tnc.radio_baud <= 0) {
+		fprintf(stderr, "TNC: radio_baud must be a bit rate, like 1200.\n");
+		exit (EXIT_FAILURE);
+	}
+	if (airtime_percent <= 0 || airtime_window <= 0) {
+		fprintf(stderr, "TNC: airtime_percent and airtime_window must be positive.\n");
+		exit (EXIT_FAILURE);
+	}
+
+	tnc.afsk = NULL;
+	tnc.demod = NULL;
+	tnc.demod_event = -1;
+	if (type == "afsk") {
+		string output = readconfig.Get(section, "output", "-");		// a WAV file, or - for raw samples on stdout
+		string input = readconfig.Get(section, "input", "");		// a WAV file, or - for raw samples on stdin, blank to only transmit
+		int decoders = readconfig.GetInteger(section, "decoders", 3);	// each tuned a bit differently, on its own core
+		int sample_rate = readconfig.GetInteger(section, "sample_rate", 48000);
+		int volume = readconfig.GetInteger(section, "volume", 50);		// percent of full scale
+		int txdelay = readconfig.GetInteger(section, "txdelay", 300);	// ms of flags before the first frame
+		tnc.afsk = new afsk_tx;
+		tnc.radio_baud = AFSK_BAUD;
+		tnc.serial.fd = -1;
+		tnc.serial.len = 0;
+		if (volume <= 0 || volume > 100 || txdelay < 0) {
+			fprintf(stderr, "TNC: volume must be 1-100 and txdelay at least 0.\n");
+			exit (EXIT_FAILURE);
+		}
+		if (!afsk_tx_init(*tnc.afsk, output.c_str(), sample_rate, volume, txdelay)) {
+			fprintf(stderr, "Could not open AFSK output %s at %i Hz: %s\n", output.c_str(), sample_rate, strerror(errno));
+			exit (EXIT_FAILURE);
+		}
+		if (verbose) printf("Soft TNC sending AFSK to %s at %i Hz\n", output.c_str(), sample_rate);
+		if (input != "") {
+			if (decoders < 1 || decoders > DEMOD_MAX_DECODERS) {
+				fprintf(stderr, "TNC: decoders must be 1-%i.\n", DEMOD_MAX_DECODERS);
+				exit (EXIT_FAILURE);
+			}
+			tnc.demod = new afsk_demod;
+			tnc.demod_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (tnc.demod_event == -1 || !demod_open(*tnc.demod, input.c_str(), sample_rate, decoders, tnc.demod_event)) {
+				fprintf(stderr, "Could not open AFSK input %s: %s\n", input.c_str(), strerror(errno));
+				exit (EXIT_FAILURE);
+			}
+			if (verbose) printf("Soft TNC decoding AFSK from %s at %i Hz with %i decoders\n", input.c_str(), tnc.demod->sample_rate, decoders);
+		}
+	} else if (type == "serial") {
+		if (!serial_open(tnc.serial, port.c_str(), baud, true)) {		// couldn't open the serial port...
+			fprintf(stderr, "Could not open KISS port %s: %s\n", port.c_str(), strerror(errno));
+			exit (EXIT_FAILURE);
+		}
+		if (verbose) printf("Successfully opened KISS port %s at %i baud\n", port.c_str(), baud);
+	} else {
+		fprintf(stderr, "TNC: type must be serial or afsk.\n");
+		exit (EXIT_FAILURE);
+	}
+	kiss_deframer_init(tnc.rx);
+	txq_init(tnc.txq, tnc.radio_baud, airtime_percent, airtime_window, monotonic_ms());
+	tnc.writing = false;
+
+	if (verbose && airtime_percent < 100) printf("Using at most %i%% of the channel at %i baud over %i seconds\n", airtime_percent, tnc.radio_baud, airtime_window);
+}	// END OF 'open_tnc'
 
 void init(int argc, char* argv[]) {		// read config, set up serial ports, etc
 	string configfile = "/etc/aprstoolkit.conf";
@@ -155,6 +198,7 @@ void init(int argc, char* argv[]) {		// read config, set up serial ports, etc
 			}
 	}
 
+	if (gps_debug || tnc_debug || sb_debug) trace_start(stdout, 50);	// debug output is formatted off the hot paths
 	if (verbose) printf("APRS Toolkit %s\n\n", VERSION);
 
 // CONFIG FILE PARSING
@@ -188,293 +232,584 @@ void init(int argc, char* argv[]) {		// read config, set up serial ports, etc
 	if (verbose) printf("Operating as %s-%i\n", mycall.c_str(), myssid);		// whew, we made it through all the tests
 
 	bool gps_enable = readconfig.GetBoolean("gps", "enable", false);
-	string kiss_port = readconfig.Get("tnc", "port", "/dev/ttyS0");
-	int kiss_baud = readconfig.GetInteger("tnc", "baud", 9600);
+	int radio_baud = readconfig.GetInteger("tnc", "radio_baud", 1200);	// of the tnc our beacons go out
 	string gps_port  = readconfig.Get("gps", "port", "/dev/ttyS1");
 	int gps_baud = readconfig.GetInteger("gps", "baud", 4800);
 
-	string beacon_via_str = readconfig.Get("beacon", "via", "");		// now we get to parse the via paramater
-	if (beacon_via_str.length() > 0) {
+	digi.enable = readconfig.GetBoolean("digi", "enable", false);
+	if (digi.enable) {
+		ax25_address(digi.mycall, (mycall + "-" + to_string(myssid)).c_str());	// checked above
+		digi.max_hops = readconfig.GetInteger("digi", "max_hops", 2);
+		digi.trace = readconfig.GetBoolean("digi", "trace", true);
+		string aliases = readconfig.Get("digi", "aliases", "WIDE1-1");	// fill-in digi by default
+		digi.alias_count = 0;
 		int current;
 		int next = -1;
-		string this_call;
-		int this_ssid;
-		do {
+		while (next < (int)aliases.length() - 1) {
 			current = next + 1;
-			next = beacon_via_str.find_first_of(",", current);
-			call = beacon_via_str.substr(current, next-current);
-			index = call.find_first_of("-");
-			if (index == -1) {	// no ssid specified
-				this_call = call;
-				this_ssid = 0;
-			} else {			// ssid was specified
-				this_call = call.substr(0,index);	// left of the dash
-				this_ssid = atoi(call.substr(index+1,2).c_str());	// right of the dash
-			}
-			if (this_call.length() > 6) {
-				fprintf(stderr,"VIA: Station callsign must be 6 characters or less.\n");
-				exit (EXIT_FAILURE);
-			}
-			if (this_ssid < 0 or myssid > 15) {
-				fprintf(stderr,"VIA: Station SSID must be between 0 and 15.\n");
+			next = aliases.find_first_of(",", current);
+			if (next == -1) next = aliases.length();
+			string alias = aliases.substr(current, next - current);
+			if (alias.length() == 0) continue;
+			if (digi.alias_count == DIGI_MAX_ALIASES || !ax25_address(digi.aliases[digi.alias_count], alias.c_str())) {
+				fprintf(stderr, "DIGI: Bad alias %s (at most %i, CALL-SSID).\n", alias.c_str(), DIGI_MAX_ALIASES);
 				exit (EXIT_FAILURE);
 			}
-			path_calls.push_back(this_call);		// input validation ok, add this to the via vectors
-			path_ssids.push_back(this_ssid);
-		} while (next != -1);
-		if (path_calls.size() > 8) {
-			fprintf(stderr,"VIA: Cannot have more than 8 digis in the path.\n");
+			digi.alias_count++;
+		}
+		if (verbose) printf("Digipeating WIDEn-N up to %i hops and %i aliases\n", digi.max_hops, digi.alias_count);
+	}
+	int dupe_entries = readconfig.GetInteger("dupe", "entries", 4096);	// packets remembered at once
+	int dupe_window = readconfig.GetInteger("dupe", "window", DUPE_WINDOW);
+	if (dupe_entries <= 0 || dupe_window <= 0) {
+		fprintf(stderr, "DUPE: entries and window must be positive.\n");
+		exit (EXIT_FAILURE);
+	}
+	dupe_init(dupes, dupe_entries, dupe_window);
+	int station_capacity = readconfig.GetInteger("stations", "capacity", 20000);	// the least recently heard go when it's full
+	if (station_capacity <= 0) {
+		fprintf(stderr, "STATIONS: capacity must be positive.\n");
+		exit (EXIT_FAILURE);
+	}
+	station_init(stations, station_capacity);
+
+	track.map = NULL;
+	string track_file = readconfig.Get("tracklog", "file", "");	// blank for no track log
+	track_sync = readconfig.GetInteger("tracklog", "sync", 10);		// at most this much is lost to a power cut
+	if (track_file != "") {
+		int track_capacity = readconfig.GetInteger("tracklog", "capacity", 131072);	// 32 bytes each, a few hours of 10 Hz fixes
+		if (!tracklog_open(track, track_file.c_str(), track_capacity, true)) {
+			fprintf(stderr, "Could not open track log %s: %s\n", track_file.c_str(), strerror(errno));
 			exit (EXIT_FAILURE);
 		}
+		if (verbose) printf("Track log %s: %u records, %lu recovered\n", track_file.c_str(), track.header->capacity, track.recovered);
+	}
+	if (!beacon_load(readconfig, beacon, sb)) exit (EXIT_FAILURE);	// beacon_load already said what was wrong
+	beacon_header(beacon, mycall.c_str(), myssid);
+	if (verbose) {		// what each format costs on the air with this path and comment
+		const char* names[] = {"uncompressed", "compressed", "mic-e"};
+		int position_len[] = {1 + APRS_POSITION_LEN, 1 + APRS_COMPRESSED_LEN, APRS_MICE_LEN};
+		for (int i=APRS_UNCOMPRESSED; i<=APRS_MICE; i++) {
+			int frame_len = beacon.header.len + position_len[i] + beacon.comment.length();
+			printf("%c %-12s beacon: %i byte frame, about %i ms at %i baud\n", i == beacon.format ? '*' : ' ', names[i], frame_len, ax25_airtime_ms(frame_len, radio_baud), radio_baud);
+		}
+	}
+	int channel_window = readconfig.GetInteger("channel", "window", 300);	// seconds of history
+	if (channel_window <= 0) {
+		fprintf(stderr, "CHANNEL: window must be a number of seconds.\n");
+		exit (EXIT_FAILURE);
+	}
+	channel_init(channel, channel_window, monotonic_ms());
+	channel.target = readconfig.GetInteger("channel", "target", 30);		// busy percent where beacon rates are as configured
+	channel.min_scale = readconfig.GetInteger("channel", "min_scale", 100);	// never beacon faster than configured, by default
+	channel.max_scale = readconfig.GetInteger("channel", "max_scale", 400);	// or more than 4 times slower
+	if (channel.target <= 0 || channel.min_scale <= 0 || channel.max_scale < channel.min_scale) {
+		fprintf(stderr, "CHANNEL: target and min_scale must be positive, and max_scale at least min_scale.\n");
+		exit (EXIT_FAILURE);
 	}
-	beacon_comment = readconfig.Get("beacon", "comment", "");
-	compress_pos = readconfig.GetBoolean("beacon", "compressed", false);
-	symbol_table = readconfig.Get("beacon", "symbol_table", "/");
-	symbol_char = readconfig.Get("beacon", "symbol", "/");
-	static_beacon_rate = readconfig.GetInteger("beacon", "static_rate", 900);
-	sb_low_speed = readconfig.GetInteger("beacon", "sb_low_speed", 5);
-	sb_low_rate = readconfig.GetInteger("beacon", "sb_low_rate", 1800);
-	sb_high_speed = readconfig.GetInteger("beacon", "sb_high_speed", 60);
-	sb_high_rate = readconfig.GetInteger("beacon", "sb_high_rate", 180);
-	sb_turn_min = readconfig.GetInteger("beacon", "sb_turn_min", 30);
-	sb_turn_time = readconfig.GetInteger("beacon", "sb_turn_time", 15);
-	sb_turn_slope = readconfig.GetInteger("beacon", "sb_turn_slope", 255);
 
-// OPEN KISS INTERFACE
+	string objects_file = readconfig.Get("objects", "file", "");
+	if (objects_file.length() > 0) {
+		if (!objects_load(objects, objects_file.c_str())) exit (EXIT_FAILURE);	// objects_load already said what was wrong
+		objects_burst = readconfig.GetInteger("objects", "burst", 4);
+		if (objects_burst <= 0) {
+			fprintf(stderr, "OBJECTS: burst must be a positive number of reports per second.\n");
+			exit (EXIT_FAILURE);
+		}
+		if (verbose) printf("Loaded %i objects from %s\n", (int)objects.objects.size(), objects_file.c_str());
+	}
 
-	// no 'if' here, since this would be pointless without a TNC
+// OPEN KISS INTERFACE
 
-	int baud_code = get_baud(kiss_baud);
+	// no 'if' here, since this would be pointless without a TNC. more TNCs
+	// go in [tnc2], [tnc3]... and are KISS ports 1, 2... to clients
 
-	if (baud_code == -1) {		// get_baud says that's an invalid baud rate
-		fprintf(stderr, "Invalid KISS baud rate %i\n", kiss_baud);
-		exit (EXIT_FAILURE);
+	for (tnc_count=0; tnc_count<MUX_MAX_PORTS; tnc_count++) {
+		string section = tnc_count == 0 ? "tnc" : "tnc" + to_string(tnc_count + 1);
+		if (tnc_count > 0 && readconfig.Get(section, "port", "") == "" && readconfig.Get(section, "type", "") == "") break;
+		open_tnc(readconfig, tncs[tnc_count], section);
 	}
 
-	kiss_iface = open_port(kiss_port, baud_code);
+// OPEN KISS SERVER
 
-	if (kiss_iface == -1) {		// couldn't open the serial port...
-		fprintf(stderr, "Could not open KISS port %s\n", kiss_port.c_str());
+	server_clients = readconfig.GetInteger("server", "max_clients", 256);
+	int server_port = readconfig.GetInteger("server", "tcp_port", 0);		// 0 for none
+	string server_bind = readconfig.Get("server", "bind", "127.0.0.1");	// local programs only, by default
+	server_unix_path = readconfig.Get("server", "unix_socket", "");
+	if (server_clients <= 0) {
+		fprintf(stderr, "SERVER: max_clients must be positive.\n");
 		exit (EXIT_FAILURE);
 	}
-
-	if (verbose) printf("Successfully opened KISS port %s at %i baud\n", kiss_port.c_str(), kiss_baud);
+	if (server_port > 0) {
+		server_tcp = mux_listen_tcp(server_bind.c_str(), server_port);
+		if (server_tcp == -1) {
+			fprintf(stderr, "SERVER: Could not listen on %s:%i: %s\n", server_bind.c_str(), server_port, strerror(errno));
+			exit (EXIT_FAILURE);
+		}
+		if (verbose) printf("KISS server listening on %s:%i\n", server_bind.c_str(), server_port);
+	}
+	if (server_unix_path.length() > 0) {
+		server_unix = mux_listen_unix(server_unix_path.c_str());
+		if (server_unix == -1) {
+			fprintf(stderr, "SERVER: Could not listen on %s: %s\n", server_unix_path.c_str(), strerror(errno));
+			exit (EXIT_FAILURE);
+		}
+		if (verbose) printf("KISS server listening on %s\n", server_unix_path.c_str());
+	}
 
 // OPEN GPS INTERFACE
 
 	if (gps_enable) {
-		baud_code = get_baud(gps_baud);
-
-		if (baud_code == -1) {
+		if (serial_baud_code(gps_baud) == -1) {
 			fprintf(stderr, "Invalid GPS baud rate %i\n", gps_baud);
 			exit (EXIT_FAILURE);
 		}
 
-		gps_iface = open_port(gps_port, baud_code);
-
-		if (gps_iface == -1) {
-			fprintf(stderr, "Could not open GPS port %s\n", gps_port.c_str());
+		if (!serial_open(gps_iface, gps_port.c_str(), gps_baud, false)) {		// blocking, gps_thread has nothing else to do
+			fprintf(stderr, "Could not open GPS port %s: %s\n", gps_port.c_str(), strerror(errno));
 			exit (EXIT_FAILURE);
 		}
 
 		if (verbose) printf("Successfully opened GPS port %s at %i baud\n", gps_port.c_str(), gps_baud);
-	} else beacon_ok = true;	// gps not enabled, use static beacons
-	if (verbose) printf("Init finished!\n\n");
-}	// END OF 'init'
 
-string ax25_callsign(const char* callsign) {		// pad a callsign with spaces to 6 chars and shift chars to the left
-	char paddedcallsign[] = {0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00};	// start with a string of spaces
-	memcpy(paddedcallsign, callsign, strlen(callsign));		// copy the shifted callsign into our padded container
-	for (int i=0;i<6;i++) {
-			paddedcallsign[i] <<= 1;		// shift all the chars in the input callsign
-		}
-	return paddedcallsign;
-}	// END OF 'ax25_callsign'
-
-char ax25_ssid(char ssid, bool hbit, bool last) {	// format an ax25 ssid byte
-	ssid <<= 1;			// shift ssid
-	if (hbit) {			// set h and c bits
-		ssid |= 0xE0;	// 11100000
-	} else {
-		ssid |= 0x60;	// 01100000
-	}
-	ssid |= last;		// set address end bit
-	return ssid;
-}
-
-void send_kiss_frame(const char* source, int source_ssid, const char* destination, int destination_ssid, vector<string> via, vector<char>via_ssids, string payload, vector<bool>via_hbits = vector<bool>()) {		// send a KISS packet to the TNC
-	// we'll build the ax25 frame before adding the kiss encapsulation
-	string buff = ax25_callsign(destination);					// add destination address
-	buff.append(1, ax25_ssid(destination_ssid, false, false));	// add destination ssid
-	buff.append(ax25_callsign(source));							// add source address
-	if (via.size() == 0) {
-		buff.append(1, ax25_ssid(source_ssid, false, true));	// no path, add source ssid and end the address field
-	} else {
-		if (via_hbits.size() == 0) {							// via_hbits was not specified, fill it with zeros
-			for (int i=0;i<via.size();i++) {
-				via_hbits.push_back(false);
+		warm.slots = NULL;
+		string warm_file = readconfig.Get("warmstart", "file", "");	// blank to wait for the receiver every time
+		warm_max_age = readconfig.GetInteger("warmstart", "max_age", 3600);
+		if (warm_file != "") {
+			if (!warmstart_open(warm, warm_file.c_str())) {
+				fprintf(stderr, "Could not open warm start file %s: %s\n", warm_file.c_str(), strerror(errno));
+				exit (EXIT_FAILURE);
+			}
+			gps_fix fix;
+			if (warmstart_load(warm, warm_max_age, fix)) {	// beacon from here until the receiver gets a fix of its own
+				current_fix.store(fix);
+				if (verbose) printf("Warm start from %.6f %.6f, %li seconds old\n", fix.lat / 1e6, fix.lon / 1e6, fix_age(fix));
 			}
 		}
-		buff.append(1, ax25_ssid(source_ssid, false, false));	// path to follow, don't end the address field just yet
-		for (int i=0;i<(via.size()-1);i++) {					// loop thru all via calls except the last
-			buff.append(ax25_callsign(via[i].c_str()));			// add this via callsign
-			buff.append(1, ax25_ssid(via_ssids[i], via_hbits[i], false)); // add this via ssid
+	} else {			// gps not enabled, use static beacons
+		warm.slots = NULL;
+		gps_fix fix = gps_fix();
+		fix.valid = true;
+		current_fix.store(fix);
+	}
+	metrics_counter(nmea_parsed, "aprs_nmea_sentences_total", "result=\"parsed\"", "NMEA sentences read from the GPS.");
+	metrics_counter(nmea_rejected, "aprs_nmea_sentences_total", "result=\"rejected\"", "NMEA sentences read from the GPS.");
+	metrics_counter(beacon_reasons[SB_STARTUP], "aprs_beacons_total", "reason=\"startup\"", "Position beacons sent, by what made them due.");
+	metrics_counter(beacon_reasons[SB_RATE], "aprs_beacons_total", "reason=\"rate\"", "Position beacons sent, by what made them due.");
+	metrics_counter(beacon_reasons[SB_TURN], "aprs_beacons_total", "reason=\"turn\"", "Position beacons sent, by what made them due.");
+	metrics_histogram(fix_age_ms, "aprs_beacon_fix_age_seconds", "", "Time from a fix coming in to a beacon being sent from it.", 1e-3);
+	metrics_histogram(pos_report_ns, "aprs_encode_seconds", "frame=\"position\"", "Time to encode and queue a frame.", 1e-9);
+	metrics_histogram(kiss_frame_ns, "aprs_encode_seconds", "frame=\"kiss\"", "Time to encode and queue a frame.", 1e-9);
+	metrics_histogram(serial_write_ns, "aprs_serial_write_seconds", "", "Time spent writing a batch of frames to a TNC.", 1e-9);
+	metrics_file = readconfig.Get("metrics", "file", "");	// blank for no metrics
+	if (metrics_file != "") {
+		int interval = readconfig.GetInteger("metrics", "interval", 15);	// seconds between snapshots
+		if (interval <= 0) {
+			fprintf(stderr, "METRICS: interval must be a positive number of seconds.\n");
+			exit (EXIT_FAILURE);
+		}
+		if (!metrics_save(metrics_file.c_str())) {
+			fprintf(stderr, "Could not write metrics file %s: %s\n", metrics_file.c_str(), strerror(errno));
+			exit (EXIT_FAILURE);
 		}
-		buff.append(ax25_callsign(via[via.size()-1].c_str()));	// finally made it to the last via call
-		buff.append(1,ax25_ssid(via_ssids[via_ssids.size()-1], via_hbits[via_hbits.size()-1], true));	// end the address field
-	}
-	buff.append("\x03\xF0");									// add control and pid bytes (ui frame)
-	buff.append(payload);										// add the actual data
-	// now we can escape any FENDs and FESCs that appear in the ax25 frame and add kiss encapsulation
-	find_and_replace(buff,"\xC0","\xDB\xDC");					// replace any FENDs with FESC,TFEND
-	find_and_replace(buff,"\xDB","\xDB\xDD");					// replace any FESCs with FESC,TFESC
-	buff.insert(0,"\xC0\x00",2);								// add kiss header
-	buff.append(1,0xC0);										// add kiss footer
-	write(kiss_iface,buff.c_str(),buff.length());				// spit this out the kiss interface
-	if (tnc_debug) printf("TNC_OUT: %s-%i to %s-%i via %i digis: %s\n", source, source_ssid, destination, destination_ssid, via.size(), payload.c_str());
+		metrics_start(metrics_file.c_str(), interval);
+		if (verbose) printf("Writing metrics to %s every %i seconds\n", metrics_file.c_str(), interval);
+	}
+	if (verbose) printf("Init finished!\n\n");
+}	// END OF 'init'
+
+void send_kiss_frame(int cls, const ax25_header& header, const char* payload, int payload_len) {		// queue a KISS packet for the TNC
+	long long start = monotonic_ns();
+	long long now = monotonic_ms();
+	int len = beacon_queue(dupes, tncs[0].txq, cls, header, payload, payload_len, now);	// encoded straight into its queue slot
+	if (len == 0) {
+		if (tnc_debug) trace("TNC_OUT: identical frame sent within %i seconds, dropped: %s\n", (int)(dupes.window / 1000), trace_text{payload, payload_len});
+		return;
+	}
+	if (len == -1) {
+		fprintf(stderr, "TNC: Payload of %i bytes is too long, frame dropped.\n", payload_len);
+		return;
+	}
+	metric_record(kiss_frame_ns, monotonic_ns() - start);
+	if (tnc_debug) {
+		char source[10];
+		char destination[10];
+		ax25_address_text(destination, header.data);
+		ax25_address_text(source, header.data + AX25_ADDR_LEN);
+		trace("TNC_OUT: %s to %s via %i digis: %s\n", source, destination, header.digis, trace_text{payload, payload_len});
+	}
 }	// END OF 'send_kiss_frame'
 
-void send_pos_report() {		// exactly what it sounds like
-	char* pos = new char[21];
-	if (compress_pos) {		// build compressed position report, yes, byte by byte.
-		pos[0] = 0x21;
-		pos[1] = symbol_table[0];
-		float lat;
-		float lon;
-		float lat_min = modf(pos_lat/100, &lat);	// separate deg and min
-		float lon_min = modf(pos_long/100, &lon);
-		lat += (lat_min/.6);	// convert min to deg and re-add it
-		lon += (lon_min/.6);
-		if (strcmp(pos_lat_dir.c_str(), "S") == 0) lat = -lat;	// assign direction sign
-		if (strcmp(pos_long_dir.c_str(), "W") == 0) lon = -lon;
-		lat = 380926 * (90 - lat);		// formula from aprs spec
-		lon = 190463 * (180 + lon);
-		pos[2] = (int)lat / 753571 + 33;	// lat/91^3+33
-		lat = (int)lat % 753571;			// remainder
-		pos[3] = (int)lat / 8281 + 33;		// remainder/91^2+33
-		lat = (int)lat % 8281;				// remainder
-		pos[4] = (int)lat / 91 + 33;		// remainder/91^1+33
-		pos[5] = (int)lat % 91 + 33;		// remainder + 33
-		pos[6] = (int)lon / 753571 + 33;
-		lon = (int)lon % 753571;
-		pos[7] = (int)lon / 8281 + 33;
-		lon = (int)lon % 8281;
-		pos[8] = (int)lon / 91 + 33;
-		pos[9] = (int)lon % 91 + 33;
-		pos[10] = symbol_char[0];
-		pos[11] = gps_hdg / 4 + 33;
-		pos[12] = (int)pow(gps_speed, 1.08 - 1) + 33;
-		pos[13] = 0x5F;
-		pos[14] = 0x00;
-	} else {
-		sprintf(pos, "!%.2f%s%s%.2f%s%s", pos_lat, pos_lat_dir.c_str(), symbol_table.c_str(), pos_long, pos_long_dir.c_str(), symbol_char.c_str());
+void send_pos_report(const gps_fix& fix) {		// exactly what it sounds like
+	if (track.map != NULL && fix.count > 0) tracklog_append(track, TRACK_BEACON, fix, beacon.format);	// not static beacons, they have no time
+	if (tnc_debug) {
+		int digi_index = station_nearest_digi(stations, fix.lat, fix.lon, 100);
+		if (digi_index != -1) {
+			char call[10];
+			station_call(call, stations.keys[digi_index]);
+			trace("TNC_OUT: nearest digi heard is %s, %.1f km\n", call, station_distance(stations, digi_index, fix.lat, fix.lon));
+		}
 	}
-	string buff = pos;
-	buff.append(beacon_comment);
-	delete pos;
-	send_kiss_frame(mycall.c_str(), myssid, PACKET_DEST, 0, path_calls, path_ssids, buff);
+	char pos[AX25_MAX_INFO];
+	ax25_header mice;
+	const ax25_header* header;
+	int len = beacon_encode(beacon, fix, pos, mice, header);
+	send_kiss_frame(TX_BEACON, *header, pos, len);
 }	// END OF 'send_pos_report'
 
 void* gps_thread(void*) {		// thread to listen to the incoming NMEA stream and update our position and time
-	string buff = "";
-	char * data = new char[1];
+	nmea_reader reader;
+	nmea_sentence sentence;
+	nmea_rmc rmc;
+	gps_fix fix = current_fix.load();		// built up here, then published to everyone else in one piece; maybe a warm start
+	nmea_init(reader);
+	unsigned long counted = 0, rejected = 0;	// of the reader's counts, already in the metrics
+	long long synced = monotonic_ms();
 
 	while (true) {
-		read(gps_iface, data, 1);
-		if (data[0] == '\n') {			// NMEA data is terminated with a newline.
-			if (buff.length() > 6) {	// but let's not bother if this was an incomplete line
-				//if (gps_debug) printf("GPS_IN: %s\n", buff.c_str());
-				if (buff.compare(0, 6, "$GPRMC") == 0) {	// GPRMC has most of the info we care about
-					string params[12];
-					int current = 7;
-					int next = 0;
-					for (int a=0; a<12; a++) {		// here we'll split the fields of the GPRMC sentence
-						next = buff.find_first_of(',', current);
-						params[a] = buff.substr(current, next - current);
-						current = next + 1;
-					}
-					if (params[1].compare("A") == 0) {
-						beacon_ok = true;
-						gps_time->tm_hour = atoi(params[0].substr(0,2).c_str());
-						gps_time->tm_min = atoi(params[0].substr(2,2).c_str());
-						gps_time->tm_sec = atoi(params[0].substr(4,2).c_str());
-						gps_time->tm_mday = atoi(params[8].substr(0,2).c_str());
-						gps_time->tm_mon = atoi(params[8].substr(2,2).c_str()) - 1;		// tm_mon is 0-11
-						gps_time->tm_year = atoi(params[8].substr(4,2).c_str()) + 100; 	// tm_year is "years since 1900"
-						pos_lat = atof(params[2].c_str());
-						pos_lat_dir = params[3];
-						pos_long = atof(params[4].c_str());
-						pos_long_dir = params[5];
-						gps_speed = atof(params[6].c_str());
-						gps_hdg = atoi(params[7].c_str());
-						if (gps_debug) printf("GPS_DEBUG: Lat:%f%s Long:%f%s MPH:%f Hdg:%i Time:%s", pos_lat, pos_lat_dir.c_str(), pos_long, pos_long_dir.c_str(), gps_speed, gps_hdg, asctime(gps_time));
-					} else {
-						beacon_ok = false;
-						if (gps_debug) printf("GPS_DEBUG: data invalid.\n");
-					}
-				}
+		int n = nmea_read(reader, gps_iface.fd);		// grab everything the port has, not a byte at a time
+		if (n <= 0) {
+			if (n == 0 || errno != EINTR) sleep(1);	// port went away, don't spin on it
+			continue;
+		}
+		while (nmea_next(reader, sentence)) {
+			if (!nmea_parse_rmc(sentence, rmc)) continue;	// RMC has most of the info we care about
+			if (fix.warm && !rmc.valid) {			// the warm start fix is only good for so long
+				long age = fix_age(fix);
+				if (age < 0 || age > warm_max_age) fix.warm = false;
 			}
-			buff = "";		// clear the buffer
-		} else {
-			buff.append(1, data[0]);	// this wasn't a newline so just add it to the buffer.
+			fix.valid = rmc.valid || fix.warm;
+			fix.count++;
+			if (rmc.valid) {
+				fix.warm = false;
+				fix.time.tm_hour = rmc.hour;
+				fix.time.tm_min = rmc.min;
+				fix.time.tm_sec = rmc.sec;
+				fix.time.tm_mday = rmc.day;
+				fix.time.tm_mon = rmc.mon - 1;		// tm_mon is 0-11
+				fix.time.tm_year = rmc.year + 100; 	// tm_year is "years since 1900"
+				fix.lat = rmc.lat;
+				fix.lon = rmc.lon;
+				fix.speed = rmc.speed;
+				fix.hdg = rmc.course / 100;
+				fix.heard = monotonic_ms();
+				if (track.map != NULL) tracklog_append(track, TRACK_FIX, fix, 0);
+				if (warm.slots != NULL) warmstart_save(warm, fix);
+			}
+			current_fix.store(fix);
+			uint64_t one = 1;
+			write(fix_event, &one, sizeof(one));		// wake up the beacon loop
+			if (gps_debug) {
+				if (rmc.valid) trace("GPS_DEBUG: Lat:%.6f Long:%.6f Knots:%.2f Hdg:%i Time:%T", fix.lat / 1e6, fix.lon / 1e6, fix.speed / 100.0, fix.hdg, (long long)timegm(&fix.time));
+				else trace("GPS_DEBUG: data invalid.\n");
+			}
+		}
+		metric_add(nmea_parsed, reader.sentences - counted);
+		metric_add(nmea_rejected, reader.rejected - rejected);
+		counted = reader.sentences;
+		rejected = reader.rejected;
+		if (track.map != NULL && monotonic_ms() - synced >= track_sync * 1000LL) {	// here rather than the event loop, it's our data
+			tracklog_sync(track);
+			synced = monotonic_ms();
 		}
 	}
 	return 0;
 } // END 'gps_thread'
 
-void cleanup(int sign) {	// clean up after catching ctrl-c
+void cleanup() {	// clean up after ctrl-c or SIGTERM, called from the event loop, never a signal handler
 	if (verbose) printf("Closing TNC interface\n");
-	close(kiss_iface);
+	for (int i=0;i<tnc_count;i++) {
+		serial_close(tncs[i].serial);
+		if (tncs[i].afsk != NULL) pcm_close(tncs[i].afsk->out);	// finish the WAV header
+	}
+	if (server_unix != -1) unlink(server_unix_path.c_str());
+	if (track.map != NULL) {
+		tracklog_sync(track);
+		tracklog_close(track);
+	}
+	warmstart_close(warm);
+	trace_flush();							// whatever debug output is still queued
+	if (metrics_file != "") metrics_save(metrics_file.c_str());	// the final numbers
 	if (verbose) printf("Closing GPS interface\n");
-	close(gps_iface);
+	serial_close(gps_iface);
 	exit (EXIT_SUCCESS);
 } // END OF 'cleanup'
 
+void receive_frame(int port, unsigned char* data, int len) {		// an AX.25 frame heard on a tnc, however it got to us
+	tnc_port& tnc = tncs[port];
+	mux_broadcast(mux, port, data, len);	// clients get everything, before we touch it
+	if (port == 0) channel_add(channel, ax25_airtime_ms(len, tnc.radio_baud), monotonic_ms());	// everything heard counts, APRS or not
+	ax25_frame frame;
+	if (!ax25_parse(data, len, frame)) return;	// not an APRS frame
+	char destination[10];
+	int destination_len = ax25_address_text(destination, frame.destination);	// Mic-E needs it as text
+	aprs_packet packet;
+	bool decoded = aprs_decode(destination, destination_len, (const char*)frame.info, frame.info_len, packet);
+	station_heard(stations, frame, decoded ? &packet : NULL, monotonic_ms());	// dupes too, they show who repeated it
+	if (tnc_debug) {
+		char source[10];
+		ax25_address_text(source, frame.source);
+		trace("TNC_IN: port %i %s to %s via %i digis: %s\n", port, source, destination, frame.digis, trace_text{(const char*)frame.info, frame.info_len});
+		if (decoded && packet.has_position) trace("TNC_IN: type %i at %.6f %.6f, symbol %c%c\n", packet.type, packet.lat / 1e6, packet.lon / 1e6, packet.table, packet.symbol);
+	}
+	if (dupe_check(dupes, dupe_key(frame.destination, frame.source, frame.info, frame.info_len), monotonic_ms())) {
+		if (tnc_debug) trace("TNC_IN: dupe, not repeated\n");
+		return;
+	}
+	if (!digi.enable) return;
+	unsigned char repeat[KISS_MAX_FRAME];		// decide first, a reserved slot may push out a queued digipeat
+	int repeat_len = digi_process(digi, data, len, frame, repeat);
+	if (repeat_len > 0) {
+		memcpy(txq_reserve(tnc.txq, TX_DIGI), repeat, repeat_len);	// back out the port it came in, ahead of everything else
+		txq_commit(tnc.txq, TX_DIGI, repeat_len, monotonic_ms());
+		if (tnc_debug) trace("TNC_DIGI: repeated %i bytes\n", repeat_len);
+	}
+}	// END OF 'receive_frame'
+
+bool receive_kiss(int port) {		// handle whatever a TNC has for us, false if it hung up or failed
+	tnc_port& tnc = tncs[port];
+	int n = kiss_read(tnc.rx, tnc.serial.fd);
+	if (n == 0) {
+		fprintf(stderr, "TNC: Port %i hung up.\n", port);
+		return false;
+	}
+	if (n == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return true;
+		fprintf(stderr, "TNC: Port %i read failed: %s\n", port, strerror(errno));
+		return false;
+	}
+	unsigned char* data;
+	int len;
+	while (kiss_next(tnc.rx, data, len)) {
+		if ((data[0] & 0x0F) != 0) continue;		// not a data frame
+		receive_frame(port, data + 1, len - 1);
+	}
+	return true;
+}	// END OF 'receive_kiss'
+
+void receive_demod(int port) {		// frames the soft tnc decoded
+	tnc_port& tnc = tncs[port];
+	uint64_t count;
+	read(tnc.demod_event, &count, sizeof(count));
+	demod_frame frame;
+	while (demod_next(*tnc.demod, frame)) {
+		if (tnc_debug) trace("TNC_AFSK: %i bytes from decoder %i\n", frame.len, frame.decoder);
+		receive_frame(port, frame.data, frame.len);
+	}
+}	// END OF 'receive_demod'
+
+void receive_client(int client) {		// frames a KISS client wants sent, by KISS port number
+	if (!mux_read(mux, client)) return;		// gone, and cleaned up already
+	unsigned char* data;
+	int len;
+	while (kiss_next(mux.clients[client].rx, data, len)) {
+		int port = data[0] >> 4;
+		if ((data[0] & 0x0F) != 0 || port >= tnc_count || len - 1 > AX25_MAX_HEADER + AX25_MAX_INFO) continue;	// only data, for a tnc we have
+		unsigned char* frame = txq_reserve(tncs[port].txq, TX_CLIENT);
+		txq_commit(tncs[port].txq, TX_CLIENT, kiss_wrap(frame, 0, data + 1, len - 1), monotonic_ms());	// each tnc is port 0 on its own line
+		if (tnc_debug) trace("TNC_CLIENT: %i bytes from client %i for port %i\n", len - 1, client, port);
+	}
+}	// END OF 'receive_client'
+
+void send_object_reports() {		// send what the object wheel has queued, a few at a time
+	time_t now = time(NULL);
+	struct tm utc;
+	gmtime_r(&now, &utc);
+	char report[AX25_MAX_INFO];
+	for (int i=0;i<objects_burst;i++) {
+		int id = objects_next(objects);
+		if (id == -1) break;
+		int len = object_report(report, objects.objects[id], utc);
+		send_kiss_frame(TX_OBJECT, beacon.header, report, len);
+	}
+}	// END OF 'send_object_reports'
+
+void transmit(int port) {		// hand a tnc whatever may go now, best first, in one write
+	tnc_port& tnc = tncs[port];
+	if (tnc.serial.len > 0) return;			// let the port drain first, so what goes next is still our choice
+	long long now = monotonic_ms();
+	struct iovec iov[TXQ_BATCH];
+	int airtime;
+	int count = txq_collect(tnc.txq, now, iov, TXQ_BATCH, airtime);
+	if (count == 0) return;
+	if (port == 0) channel_add(channel, airtime, now);		// our own frames load the channel too
+	if (tnc.afsk != NULL) {					// soft tnc, render the batch as one transmission
+		unsigned char frames[TXQ_BATCH][AX25_MAX_HEADER + AX25_MAX_INFO];
+		const unsigned char* frame_ptrs[TXQ_BATCH];
+		int lens[TXQ_BATCH];
+		for (int i=0;i<count;i++) {
+			lens[i] = kiss_unwrap(frames[i], (const unsigned char*)iov[i].iov_base, iov[i].iov_len);
+			frame_ptrs[i] = frames[i];
+		}
+		if (!afsk_send(*tnc.afsk, frame_ptrs, lens, count)) fprintf(stderr, "TNC: Port %i AFSK output failed: %s\n", port, strerror(errno));
+		else if (tnc_debug) trace("TNC_TX: %i frames to port %i as AFSK\n", count, port);
+		return;
+	}
+	long long start = monotonic_ns();
+	long long drained = serial_writev(tnc.serial, iov, count, now);
+	metric_record(serial_write_ns, monotonic_ns() - start);
+	if (drained == -1) fprintf(stderr, "TNC: Port %i is backed up or failed, %i frames dropped.\n", port, count);
+	else if (tnc_debug) trace("TNC_TX: %i frames to port %i, out in %lli ms\n", count, port, drained - now);
+}	// END OF 'transmit'
+
+enum event_type {		// what an epoll event is for, see EVENT_TAG
+	EVENT_TIMER,		// beacon and tx timers and the fix eventfd: just take a fresh look at everything
+	EVENT_OBJECTS,
+	EVENT_TNC,
+	EVENT_DEMOD,		// a soft tnc decoded something
+	EVENT_LISTEN,
+	EVENT_CLIENT,
+	EVENT_SIGNAL		// ctrl-c or SIGTERM, through a signalfd
+};
+
+void epoll_watch(int epfd, int fd, int type, int index) {	// add a fd to the event loop
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u64 = EVENT_TAG(type, index);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		fprintf(stderr, "Could not watch fd %i: %s\n", fd, strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+}	// END OF 'epoll_watch'
+
+void tnc_drop(int epfd, int port) {		// stop using a tnc that failed, rather than spin on its events
+	tnc_port& tnc = tncs[port];
+	epoll_ctl(epfd, EPOLL_CTL_DEL, tnc.serial.fd, NULL);
+	serial_close(tnc.serial);			// discards whatever was still queued
+	tnc.writing = false;
+	fprintf(stderr, "TNC: Port %i closed, restart to use it again.\n", port);
+}	// END OF 'tnc_drop'
+
 int main(int argc, char* argv[]) {
 
-	signal(SIGINT,&cleanup);	// catch ctrl-c
+	sigset_t stop;				// ctrl-c and being stopped, so outputs get closed properly
+	sigemptyset(&stop);
+	sigaddset(&stop, SIGINT);
+	sigaddset(&stop, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop, NULL);	// before init() starts any threads, so the signalfd below is the only way they come in
 
 	init(argc, argv);	// get everything ready to go
 
-	if (gps_iface > 0) {
+	// everything below happens in one event loop: a new fix from gps_thread,
+	// data from the TNC or the beacon timer firing wakes us up immediately
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	int beacon_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	int tx_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);	// airtime budget has room again
+	fix_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	int stop_fd = signalfd(-1, &stop, SFD_NONBLOCK | SFD_CLOEXEC);	// cleanup() takes locks and does stdio, so not from a handler
+	if (epfd == -1 || beacon_timer == -1 || tx_timer == -1 || fix_event == -1 || stop_fd == -1) {
+		fprintf(stderr, "Could not set up event loop: %s\n", strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+	epoll_watch(epfd, beacon_timer, EVENT_TIMER, beacon_timer);
+	epoll_watch(epfd, tx_timer, EVENT_TIMER, tx_timer);
+	epoll_watch(epfd, fix_event, EVENT_TIMER, fix_event);
+	epoll_watch(epfd, stop_fd, EVENT_SIGNAL, stop_fd);
+	for (int i=0;i<tnc_count;i++) {
+		if (tncs[i].serial.fd != -1) epoll_watch(epfd, tncs[i].serial.fd, EVENT_TNC, i);
+		if (tncs[i].demod_event != -1) epoll_watch(epfd, tncs[i].demod_event, EVENT_DEMOD, i);
+	}
+	mux_init(mux, epfd, EVENT_CLIENT, server_clients);
+	if (server_tcp != -1) epoll_watch(epfd, server_tcp, EVENT_LISTEN, server_tcp);
+	if (server_unix != -1) epoll_watch(epfd, server_unix, EVENT_LISTEN, server_unix);
+
+	int object_timer = -1;					// one second ticks for the object wheel
+	unsigned long object_tick = 0;
+	if (objects.objects.size() > 0) {
+		object_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		struct itimerspec tick = {{1, 0}, {1, 0}};
+		timerfd_settime(object_timer, 0, &tick, NULL);
+		epoll_watch(epfd, object_timer, EVENT_OBJECTS, object_timer);
+		objects_start(objects, object_tick);
+	}
+
+	if (gps_iface.fd != -1) {
 		pthread_t gps_t;
 		pthread_create(&gps_t, NULL, &gps_thread, NULL);	// start the gps interface thread if the gps interface was opened
 	}
 
-	sleep (1);	// let everything 'settle'
-
-	int beacon_rate = static_beacon_rate;
-	float turn_threshold = 0;
-	int last_hdg = gps_hdg;
-	int hdg_change = 0;
-	float speed;
-	int beacon_timer = beacon_rate;			// send startup beacon
-	while (true) {							// then send them periodically after that
-		if (beacon_timer >= beacon_rate) {	// if it's time...
-			while (!beacon_ok) sleep (1);	// wait if gps data not valid
-			send_pos_report();				// send a beacon
-			beacon_timer = 0;
-			hdg_change = 0;
+	while (true) {
+		gps_fix fix = current_fix.load();		// one consistent snapshot per pass
+		long long now = monotonic_ms();
+		sb.scale = channel_scale(channel, now);
+		long long due = sb_update(sb, fix.speed / 100.0f, fix.hdg, now);
+		if (due <= now && fix.valid) {			// if it's time... (and gps data is valid, else wait for the next fix)
+			long long start = monotonic_ns();
+			send_pos_report(fix);				// send a beacon
+			metric_record(pos_report_ns, monotonic_ns() - start);
+			metric_add(beacon_reasons[sb.reason]);
+			if (fix.heard != 0) metric_record(fix_age_ms, now - fix.heard);	// not static or warm start beacons
+			sb_beacon_sent(sb, fix.hdg, now);
+			due = sb_update(sb, fix.speed / 100.0f, fix.hdg, now);
 		}
-
-		if (static_beacon_rate == 0) {		// here we will implement SmartBeaconing(tm) from HamHUD.net
-			speed = gps_speed  * 1.15078;	// convert knots to mph
-			if (speed < sb_low_speed) {	// see http://www.hamhud.net/hh2/smartbeacon.html for more info
-				beacon_rate = sb_low_rate;
-			} else if (speed > sb_high_speed) {
-				beacon_rate = sb_high_rate;
-			} else {
-				beacon_rate = sb_high_rate * sb_high_speed / speed;
+		if (sb_debug) trace("SB_DEBUG: Rate:%i Timer:%lli HdgChg:%i Thres:%f Busy:%i%% Scale:%i%%\n", sb.rate, (now - sb.last_beacon) / 1000, sb.hdg_change, sb.turn_threshold, channel_busy(channel, now), sb.scale);
+
+		struct itimerspec timer = {};			// re-arm the beacon timer for the new deadline
+		if (due > now) {
+			timer.it_value.tv_sec = due / 1000;
+			timer.it_value.tv_nsec = due % 1000 * 1000000;
+		}										// else leave it disarmed, we're waiting on a valid fix
+		timerfd_settime(beacon_timer, TFD_TIMER_ABSTIME, &timer, NULL);
+
+		long long tx_due = -1;					// earliest a tnc's airtime budget lets it go again
+		for (int p=0;p<tnc_count;p++) {
+			tnc_port& tnc = tncs[p];
+			if (tnc.serial.fd == -1 && tnc.afsk == NULL) continue;	// dropped, see tnc_drop
+			transmit(p);						// beacons from above, digipeats, objects and clients from the last pass
+			long long next = tnc.serial.len > 0 ? -1 : txq_next(tnc.txq, monotonic_ms());	// while the port is busy, EPOLLOUT wakes us
+			if (next > 0 && (tx_due == -1 || next < tx_due)) tx_due = next;
+			if (tnc.writing != (tnc.serial.len > 0)) {	// only ask about EPOLLOUT while something is queued
+				tnc.writing = tnc.serial.len > 0;
+				struct epoll_event ev;
+				ev.events = tnc.writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+				ev.data.u64 = EVENT_TAG(EVENT_TNC, p);
+				epoll_ctl(epfd, EPOLL_CTL_MOD, tnc.serial.fd, &ev);
+			}
+		}
+		struct itimerspec tx_time = {};
+		if (tx_due > 0) {
+			tx_time.it_value.tv_sec = tx_due / 1000;
+			tx_time.it_value.tv_nsec = tx_due % 1000 * 1000000;
+		}
+		timerfd_settime(tx_timer, TFD_TIMER_ABSTIME, &tx_time, NULL);
+
+		struct epoll_event events[64];
+		int n = epoll_wait(epfd, events, 64, -1);
+		for (int i=0;i<n;i++) {
+			int type = EVENT_TYPE(events[i].data.u64);
+			int index = EVENT_INDEX(events[i].data.u64);
+			if (type == EVENT_TIMER) {
+				uint64_t count;
+				read(index, &count, sizeof(count));	// reset it, the loop will take a fresh look at everything
+			} else if (type == EVENT_OBJECTS) {
+				uint64_t ticks;
+				if (read(object_timer, &ticks, sizeof(ticks)) == sizeof(ticks)) object_tick += ticks;	// catch up if we were held up
+				objects_tick(objects, object_tick);
+				send_object_reports();
+			} else if (type == EVENT_TNC) {
+				bool ok = true;
+				if ((events[i].events & EPOLLOUT) && !serial_flush(tncs[index].serial)) {
+					fprintf(stderr, "TNC: Port %i write failed: %s\n", index, strerror(errno));
+					ok = false;
+				}
+				if (ok && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) ok = receive_kiss(index);	// take what's left, even on a hangup
+				if (ok && (events[i].events & (EPOLLERR | EPOLLHUP))) {
+					fprintf(stderr, "TNC: Port %i hung up.\n", index);
+					ok = false;
+				}
+				if (!ok) tnc_drop(epfd, index);
+			} else if (type == EVENT_DEMOD) {
+				receive_demod(index);
+			} else if (type == EVENT_LISTEN) {
+				int client = mux_accept(mux, index);
+				if (client != -1 && verbose) printf("KISS client %i connected\n", client);
+			} else if (type == EVENT_SIGNAL) {
+				cleanup();
+			} else if (type == EVENT_CLIENT && mux.clients[index].fd != -1) {	// may have been dropped earlier in this batch
+				if (events[i].events & EPOLLOUT) mux_flush(mux, index);
+				if (mux.clients[index].fd != -1 && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) receive_client(index);
 			}
-			turn_threshold = sb_turn_min + sb_turn_slope / speed;
-			hdg_change += gps_hdg - last_hdg;
-			last_hdg = gps_hdg;
-			if (abs(hdg_change) > turn_threshold && beacon_timer > sb_turn_time) beacon_timer = beacon_rate;
 		}
-		if (sb_debug) printf("SB_DEBUG: Rate:%i Timer:%i HdgChg:%i Thres:%f\n", beacon_rate, beacon_timer, hdg_change, turn_threshold);
-
-		sleep(1);
-		beacon_timer++;
 	}
 
 	return 0;
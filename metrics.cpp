@@ -0,0 +1,121 @@
+// Counters and latency histograms, written out in the Prometheus text format.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <pthread.h>
+#include <unistd.h>
+#include "metrics.h"
+
+struct metric_entry {			// one registered counter or histogram
+	const char* name;
+	const char* labels;
+	const char* help;
+	metric_counter* counter;	// one of these two
+	metric_histogram* histogram;
+	double unit;
+};
+
+static metric_entry metrics_registry[METRICS_MAX];
+static int metrics_count = 0;
+static const char* metrics_path;
+static int metrics_interval;
+
+static void add_entry(const char* name, const char* labels, const char* help, metric_counter* counter, metric_histogram* histogram, double unit) {
+	if (metrics_count == METRICS_MAX) {
+		fprintf(stderr, "METRICS: More than %i metrics registered.\n", METRICS_MAX);
+		exit (EXIT_FAILURE);
+	}
+	metric_entry& entry = metrics_registry[metrics_count++];
+	entry.name = name;
+	entry.labels = labels;
+	entry.help = help;
+	entry.counter = counter;
+	entry.histogram = histogram;
+	entry.unit = unit;
+}
+
+void metrics_counter(metric_counter& counter, const char* name, const char* labels, const char* help) {
+	counter.value.store(0, std::memory_order_relaxed);
+	add_entry(name, labels, help, &counter, NULL, 0);
+}	// END OF 'metrics_counter'
+
+void metrics_histogram(metric_histogram& histogram, const char* name, const char* labels, const char* help, double unit) {
+	for (int i=0;i<METRIC_BUCKETS;i++) histogram.buckets[i].store(0, std::memory_order_relaxed);
+	histogram.sum.store(0, std::memory_order_relaxed);
+	add_entry(name, labels, help, NULL, &histogram, unit);
+}	// END OF 'metrics_histogram'
+
+static uint64_t bucket_top(int bucket) {		// the largest value that lands in a bucket
+	if (bucket < (1 << METRIC_SUB_BITS)) return bucket;
+	int shift = (bucket >> METRIC_SUB_BITS) - 1;		// the top bit less METRIC_SUB_BITS
+	uint64_t low = (uint64_t)((1 << METRIC_SUB_BITS) | (bucket & ((1 << METRIC_SUB_BITS) - 1))) << shift;
+	return low + ((uint64_t)1 << shift) - 1;
+}
+
+static void write_histogram(FILE* out, const metric_entry& entry) {
+	unsigned long long counts[METRIC_BUCKETS];			// copy it first, so the cumulative counts add up
+	for (int i=0;i<METRIC_BUCKETS;i++) counts[i] = entry.histogram->buckets[i].load(std::memory_order_relaxed);
+	unsigned long long sum = entry.histogram->sum.load(std::memory_order_relaxed);
+	const char* comma = entry.labels[0] != 0 ? "," : "";
+	unsigned long long total = 0;
+	for (int i=0;i<METRIC_BUCKETS-1;i++) {			// only buckets that ever had anything, they never empty again
+		if (counts[i] == 0) continue;
+		total += counts[i];
+		fprintf(out, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", entry.name, entry.labels, comma, bucket_top(i) * entry.unit, total);
+	}
+	total += counts[METRIC_BUCKETS-1];
+	fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", entry.name, entry.labels, comma, total);
+	const char* open = entry.labels[0] != 0 ? "{" : "";
+	const char* close = entry.labels[0] != 0 ? "}" : "";
+	fprintf(out, "%s_sum%s%s%s %.9g\n", entry.name, open, entry.labels, close, sum * entry.unit);
+	fprintf(out, "%s_count%s%s%s %llu\n", entry.name, open, entry.labels, close, total);
+}
+
+void metrics_write(FILE* out) {
+	for (int i=0;i<metrics_count;i++) {
+		const metric_entry& entry = metrics_registry[i];
+		if (i == 0 || strcmp(entry.name, metrics_registry[i-1].name) != 0) {	// a new family
+			fprintf(out, "# HELP %s %s\n", entry.name, entry.help);
+			fprintf(out, "# TYPE %s %s\n", entry.name, entry.counter != NULL ? "counter" : "histogram");
+		}
+		if (entry.counter != NULL) {
+			unsigned long long value = entry.counter->value.load(std::memory_order_relaxed);
+			if (entry.labels[0] != 0) fprintf(out, "%s{%s} %llu\n", entry.name, entry.labels, value);
+			else fprintf(out, "%s %llu\n", entry.name, value);
+		} else {
+			write_histogram(out, entry);
+		}
+	}
+}	// END OF 'metrics_write'
+
+bool metrics_save(const char* path) {
+	std::string temp = std::string(path) + ".tmp";
+	FILE* out = fopen(temp.c_str(), "w");
+	if (out == NULL) return false;
+	metrics_write(out);
+	bool ok = fclose(out) == 0;
+	if (ok) ok = rename(temp.c_str(), path) == 0;
+	if (!ok) unlink(temp.c_str());
+	return ok;
+}	// END OF 'metrics_save'
+
+static void* metrics_thread(void*) {
+	bool failed = false;							// say so once, not every interval
+	while (true) {
+		sleep(metrics_interval);
+		bool ok = metrics_save(metrics_path);
+		if (!ok && !failed) fprintf(stderr, "METRICS: Could not write %s\n", metrics_path);
+		failed = !ok;
+	}
+	return NULL;
+}
+
+void metrics_start(const char* path, int interval) {
+	metrics_path = path;
+	metrics_interval = interval;
+	pthread_t thread;
+	pthread_create(&thread, NULL, &metrics_thread, NULL);
+	pthread_detach(thread);
+}	// END OF 'metrics_start'
@@ -0,0 +1,71 @@
+// Counters and latency histograms, written out in the Prometheus text format.
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+
+#define METRIC_SUB_BITS 3		// 8 buckets per power of two, so a bucket is within 12.5%
+#define METRIC_BUCKETS 240		// values 0 to 2^32, the last bucket takes anything bigger
+#define METRICS_MAX 32			// counters and histograms registered, in all
+
+// Everything is updated with relaxed atomic adds and read the same way, so
+// recording never waits and a snapshot never stops anyone recording. A
+// snapshot taken while a value is being recorded may be one off between a
+// histogram's buckets and its sum, which is fine for monitoring. Values are
+// 64 bits everywhere, 32-bit ARM included: a sum of nanoseconds would wrap
+// in seconds otherwise.
+struct metric_counter {
+	std::atomic<uint64_t> value;
+};
+
+// Log-linear, like HdrHistogram: values below 8 get a bucket each, above
+// that every power of two is split into 8. Plain integers, in whatever unit
+// the histogram was registered with.
+struct metric_histogram {
+	std::atomic<uint64_t> buckets[METRIC_BUCKETS];
+	std::atomic<uint64_t> sum;
+};
+
+// Register a counter under a metric name ("aprs_beacons_total") and a label
+// set ('reason="turn"', or "" for none). Counters sharing a name make one
+// metric family and must be registered one after another. Do this from
+// init(), before anything records; the strings have to outlive the program.
+void metrics_counter(metric_counter& counter, const char* name, const char* labels, const char* help);
+
+// The same for a histogram. 'unit' is a recorded value in seconds, 1e-9 for
+// values in nanoseconds.
+void metrics_histogram(metric_histogram& histogram, const char* name, const char* labels, const char* help, double unit);
+
+inline void metric_add(metric_counter& counter, uint64_t n = 1) {
+	counter.value.fetch_add(n, std::memory_order_relaxed);
+}
+
+inline int metric_bucket(uint64_t value) {		// which bucket a value falls in
+	if (value < (1 << METRIC_SUB_BITS)) return value;
+	int bits = 63 - __builtin_clzll(value);			// the top bit, at least METRIC_SUB_BITS
+	int bucket = (bits - METRIC_SUB_BITS + 1) << METRIC_SUB_BITS | (value >> (bits - METRIC_SUB_BITS) & ((1 << METRIC_SUB_BITS) - 1));
+	return bucket < METRIC_BUCKETS ? bucket : METRIC_BUCKETS - 1;
+}
+
+inline void metric_record(metric_histogram& histogram, long long value) {
+	if (value < 0) value = 0;						// a clock went backwards, or close enough to nothing
+	histogram.buckets[metric_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+	histogram.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+// Write a snapshot of everything registered to 'out'.
+void metrics_write(FILE* out);
+
+// Write a snapshot to 'path' through a temporary file renamed over it, so a
+// scraper (node_exporter's textfile collector) never sees half a file.
+// Returns false if the file couldn't be written.
+bool metrics_save(const char* path);
+
+// Start a thread saving to 'path' every 'interval' seconds. The path has to
+// outlive the program.
+void metrics_start(const char* path, int interval);
+
+#endif  // __METRICS_H__
@@ -0,0 +1,194 @@
+// KISS multiplexer: several TNCs and local KISS clients in one event loop.
+
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "mux.h"
+
+void mux_init(kiss_mux& mux, int epfd, int client_type, int max_clients) {
+	mux.epfd = epfd;
+	mux.client_type = client_type;
+	mux.clients = new kiss_client[max_clients];
+	mux.max_clients = max_clients;
+	mux.active = new int[max_clients];
+	mux.active_count = 0;
+	mux.free_clients = new int[max_clients];
+	mux.free_client_count = max_clients;
+	for (int i=0;i<max_clients;i++) {
+		mux.clients[i].fd = -1;
+		mux.free_clients[i] = max_clients - 1 - i;		// hand out low slots first
+	}
+	int buffers = max_clients * MUX_CLIENT_QUEUE + 1;		// every queue full, and one more on its way in
+	mux.buffers = new kiss_buffer[buffers];
+	mux.free_buffers = new kiss_buffer*[buffers];
+	mux.free_buffer_count = buffers;
+	for (int i=0;i<buffers;i++) mux.free_buffers[i] = &mux.buffers[i];
+	mux.dropped = 0;
+}	// END OF 'mux_init'
+
+static int listen_on(int fd, const struct sockaddr* addr, socklen_t len) {	// bind and listen, or close and -1
+	if (fd == -1) return -1;
+	if (bind(fd, addr, len) == -1 || listen(fd, 16) == -1) {
+		int saved = errno;
+		close(fd);
+		errno = saved;
+		return -1;
+	}
+	return fd;
+}
+
+int mux_listen_tcp(const char* address, int port) {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	int on = 1;
+	if (fd != -1) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));	// restart without waiting out TIME_WAIT
+	return listen_on(fd, (struct sockaddr*)&addr, sizeof(addr));
+}	// END OF 'mux_listen_tcp'
+
+int mux_listen_unix(const char* path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);											// left over from the last run
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	return listen_on(fd, (struct sockaddr*)&addr, sizeof(addr));
+}	// END OF 'mux_listen_unix'
+
+static void watch(kiss_mux& mux, int client, int op) {	// (re)register a client for input, and output if it's waiting
+	kiss_client& c = mux.clients[client];
+	struct epoll_event ev;
+	ev.events = c.writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.u64 = EVENT_TAG(mux.client_type, client);
+	epoll_ctl(mux.epfd, op, c.fd, &ev);
+}
+
+int mux_accept(kiss_mux& mux, int listen_fd) {
+	int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd == -1) return -1;
+	if (mux.free_client_count == 0) {						// full, say no rather than leave it hanging
+		close(fd);
+		return -1;
+	}
+	int client = mux.free_clients[--mux.free_client_count];
+	kiss_client& c = mux.clients[client];
+	c.fd = fd;
+	kiss_deframer_init(c.rx);
+	c.head = 0;
+	c.len = 0;
+	c.offset = 0;
+	c.writing = false;
+	c.dropped = 0;
+	c.slot = mux.active_count;
+	mux.active[mux.active_count++] = client;
+	watch(mux, client, EPOLL_CTL_ADD);
+	return client;
+}	// END OF 'mux_accept'
+
+static void release(kiss_mux& mux, kiss_buffer* buffer) {
+	if (--buffer->refs == 0) mux.free_buffers[mux.free_buffer_count++] = buffer;
+}
+
+void mux_close(kiss_mux& mux, int client) {
+	kiss_client& c = mux.clients[client];
+	if (c.fd == -1) return;
+	close(c.fd);											// also takes it out of epoll
+	c.fd = -1;
+	for (int i=0;i<c.len;i++) release(mux, c.queue[(c.head + i) % MUX_CLIENT_QUEUE]);
+	c.len = 0;
+	int last = mux.active[--mux.active_count];				// move the last active client into its place
+	mux.active[c.slot] = last;
+	mux.clients[last].slot = c.slot;
+	mux.free_clients[mux.free_client_count++] = client;
+}	// END OF 'mux_close'
+
+bool mux_read(kiss_mux& mux, int client) {
+	int n = kiss_read(mux.clients[client].rx, mux.clients[client].fd);
+	if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+		mux_close(mux, client);
+		return false;
+	}
+	return true;
+}	// END OF 'mux_read'
+
+void mux_flush(kiss_mux& mux, int client) {
+	kiss_client& c = mux.clients[client];
+	while (c.len > 0) {
+		struct iovec iov[MUX_BATCH];
+		int count = c.len < MUX_BATCH ? c.len : MUX_BATCH;
+		for (int i=0;i<count;i++) {
+			kiss_buffer* buffer = c.queue[(c.head + i) % MUX_CLIENT_QUEUE];
+			iov[i].iov_base = buffer->data;
+			iov[i].iov_len = buffer->len;
+		}
+		iov[0].iov_base = (unsigned char*)iov[0].iov_base + c.offset;
+		iov[0].iov_len -= c.offset;
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+		ssize_t n = sendmsg(c.fd, &msg, MSG_NOSIGNAL);		// a client going away mustn't SIGPIPE us
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			mux_close(mux, client);
+			return;
+		}
+		n += c.offset;										// count from the start of the first frame
+		while (c.len > 0 && n >= c.queue[c.head]->len) {	// let go of what went out whole
+			n -= c.queue[c.head]->len;
+			release(mux, c.queue[c.head]);
+			c.head = (c.head + 1) % MUX_CLIENT_QUEUE;
+			c.len--;
+		}
+		c.offset = n;
+	}
+	if (c.writing != (c.len > 0)) {							// only ask about EPOLLOUT while something is waiting
+		c.writing = c.len > 0;
+		watch(mux, client, EPOLL_CTL_MOD);
+	}
+}	// END OF 'mux_flush'
+
+void mux_broadcast(kiss_mux& mux, int port, const unsigned char* frame, int len) {
+	if (mux.active_count == 0) return;
+	if (len > AX25_MAX_HEADER + AX25_MAX_INFO) {		// never out of buffers, see kiss_mux
+		mux.dropped++;
+		return;
+	}
+	kiss_buffer* buffer = mux.free_buffers[--mux.free_buffer_count];
+	buffer->len = kiss_wrap(buffer->data, port, frame, len);	// encoded once for everyone
+	buffer->refs = 1;										// ours, until everyone has had a go
+	for (int i=0;i<mux.active_count;i++) {
+		int client = mux.active[i];
+		kiss_client& c = mux.clients[client];
+		if (c.len == MUX_CLIENT_QUEUE) {					// too slow, it misses this one
+			c.dropped++;
+			continue;
+		}
+		c.queue[(c.head + c.len) % MUX_CLIENT_QUEUE] = buffer;
+		c.len++;
+		buffer->refs++;
+		if (!c.writing) {
+			mux_flush(mux, client);							// may close it, which moves another client into slot i
+			if (mux.clients[client].fd == -1) i--;
+		}
+	}
+	release(mux, buffer);
+}	// END OF 'mux_broadcast'
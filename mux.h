@@ -0,0 +1,97 @@
+// KISS multiplexer: several TNCs and local KISS clients in one event loop.
+
+#ifndef __MUX_H__
+#define __MUX_H__
+
+#include "afsk.h"
+#include "ax25.h"
+#include "demod.h"
+#include "kiss.h"
+#include "serial.h"
+#include "txq.h"
+
+#define MUX_MAX_PORTS 16		// KISS port numbers are a nibble
+#define MUX_CLIENT_QUEUE 64		// frames waiting for one client before it counts as too slow
+#define MUX_BATCH 16			// most frames written to a client in one go
+
+// epoll events carry what they are for and an index, rather than the fd.
+#define EVENT_TAG(type, index) ((unsigned long long)(type) << 32 | (unsigned int)(index))
+#define EVENT_TYPE(tag) ((int)((tag) >> 32))
+#define EVENT_INDEX(tag) ((int)((tag) & 0xFFFFFFFF))
+
+struct tnc_port {				// one TNC on a serial port, KISS port number is its index
+	serial_port serial;			// fd -1 for a soft TNC
+	afsk_tx* afsk;				// soft TNC transmitter instead of a serial port, NULL if not
+	afsk_demod* demod;			// soft TNC receiver, NULL if not
+	int demod_event;			// eventfd the decoders poke when they have frames, -1 without one
+	kiss_deframer rx;
+	tx_queue txq;
+	int radio_baud;				// on-air bit rate, for airtime
+	bool writing;				// watching the port for EPOLLOUT
+};
+
+struct kiss_buffer {			// a frame encoded once and shared by every client sending it
+	int refs;					// client queues holding it, back to the pool at 0
+	int len;
+	unsigned char data[KISS_MAX_FRAME];
+};
+
+struct kiss_client {			// a program talking KISS to us over TCP or a unix socket
+	int fd;						// -1 while the slot is free
+	kiss_deframer rx;
+	kiss_buffer* queue[MUX_CLIENT_QUEUE];	// ring of frames waiting to go out
+	int head;
+	int len;
+	int offset;					// bytes of the first frame already written
+	int slot;					// where it is in the mux's active list
+	bool writing;				// watching the socket for EPOLLOUT
+	unsigned long dropped;		// frames skipped because it wasn't keeping up
+};
+
+// Frames heard on any TNC are KISS encoded once into a pooled, refcounted
+// buffer and every client's queue just points at it. A client that falls
+// MUX_CLIENT_QUEUE frames behind misses frames rather than holding up the
+// others or growing without bound. There is a buffer for every queue slot of
+// every client plus the one being filled, so however many clients stall, the
+// rest still get every frame. Everything is allocated by mux_init().
+// The mux registers its clients with 'epfd' itself, tagged 'client_type'.
+struct kiss_mux {
+	int epfd;
+	int client_type;
+	kiss_client* clients;
+	int max_clients;
+	int* active;				// indexes of the connected clients
+	int active_count;
+	int* free_clients;			// stack of unused client slots
+	int free_client_count;
+	kiss_buffer* buffers;
+	kiss_buffer** free_buffers;	// stack of unused buffers
+	int free_buffer_count;
+	unsigned long dropped;		// frames too big to pass on
+};
+
+void mux_init(kiss_mux& mux, int epfd, int client_type, int max_clients);
+
+// Open a non-blocking listening socket. Returns the fd, or -1 with errno set.
+int mux_listen_tcp(const char* address, int port);
+int mux_listen_unix(const char* path);
+
+// Accept a connection waiting on 'listen_fd'. Returns the client index, or -1
+// if there was none or we're full (then it's closed straight away).
+int mux_accept(kiss_mux& mux, int listen_fd);
+
+void mux_close(kiss_mux& mux, int client);
+
+// Read what a client sent into its deframer; take frames out with
+// kiss_next(mux.clients[client].rx, ...). Closes the client and returns false
+// if it hung up or failed.
+bool mux_read(kiss_mux& mux, int client);
+
+// Queue an AX.25 frame heard on TNC 'port' for every client, and write it to
+// those that aren't already waiting on their socket.
+void mux_broadcast(kiss_mux& mux, int port, const unsigned char* frame, int len);
+
+// Write what's queued for a client, when epoll says it can take more.
+void mux_flush(kiss_mux& mux, int client);
+
+#endif  // __MUX_H__
@@ -0,0 +1,148 @@
+// Streaming NMEA 0183 reader that splits sentences in place.
+
+#include <cstring>
+#include <unistd.h>
+#include "nmea.h"
+
+static int hex_value(char c) {		// value of a hex digit, or -1
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+static int digits(const char* p, int n) {	// value of exactly n decimal digits, or -1
+	int value = 0;
+	for (int i=0;i<n;i++) {
+		if (p[i] < '0' || p[i] > '9') return -1;
+		value = value * 10 + p[i] - '0';
+	}
+	return value;
+}
+
+void nmea_init(nmea_reader& reader) {
+	reader.fill = 0;
+	reader.scan = 0;
+	reader.sentences = 0;
+	reader.rejected = 0;
+}	// END OF 'nmea_init'
+
+int nmea_read(nmea_reader& reader, int fd) {
+	int n = read(fd, reader.buf + reader.fill, NMEA_BUFFER_SIZE - reader.fill);
+	if (n > 0) reader.fill += n;
+	return n;
+}	// END OF 'nmea_read'
+
+bool nmea_next(nmea_reader& reader, nmea_sentence& sentence) {
+	while (true) {
+		char* line = reader.buf + reader.scan;
+		char* end = (char*)memchr(line, '\n', reader.fill - reader.scan);	// NMEA data is terminated with a newline.
+		if (end == NULL) break;
+		reader.scan = end - reader.buf + 1;
+		int len = end - line;
+		if (len > 0 && line[len-1] == '\r') len--;
+		if (len == 0) continue;								// blank line, not worth counting
+		if (nmea_parse(line, len, sentence)) {
+			reader.sentences++;
+			return true;
+		}
+		reader.rejected++;
+	}
+
+	int partial = reader.fill - reader.scan;				// only an incomplete line is left, move it to the front
+	if (partial > NMEA_MAX_SENTENCE * 2) {					// no newline in sight, this is line noise
+		reader.rejected++;
+		partial = 0;
+	} else if (partial > 0 && reader.scan > 0) {
+		memmove(reader.buf, reader.buf + reader.scan, partial);
+	}
+	reader.fill = partial;
+	reader.scan = 0;
+	return false;
+}	// END OF 'nmea_next'
+
+bool nmea_parse(const char* line, int len, nmea_sentence& sentence) {
+	if (len < 7 || len > NMEA_MAX_SENTENCE || line[0] != '$') return false;
+	unsigned char sum = 0;
+	int count = 0;
+	int start = 1;
+	int i;
+	for (i=1;i<len;i++) {			// split fields and xor the checksum in the same pass
+		char c = line[i];
+		if (c == ',' || c == '*') {
+			if (count < NMEA_MAX_FIELDS) {
+				sentence.fields[count].ptr = line + start;
+				sentence.fields[count].len = i - start;
+				count++;
+			}
+			start = i + 1;
+			if (c == '*') break;
+		}
+		sum ^= c;
+	}
+	if (i + 3 != len) return false;	// no checksum, or junk after it
+	int hi = hex_value(line[i+1]);
+	int lo = hex_value(line[i+2]);
+	if (hi < 0 || lo < 0 || sum != (hi << 4 | lo)) return false;
+	sentence.count = count;
+	return true;
+}	// END OF 'nmea_parse'
+
+bool nmea_fixed(const nmea_field& field, int decimals, long& value) {
+	const char* p = field.ptr;
+	const char* end = field.ptr + field.len;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+	if (p == end) return false;
+	long v = 0;
+	for (; p < end && *p != '.'; p++) {		// whole part
+		if (*p < '0' || *p > '9') return false;
+		v = v * 10 + *p - '0';
+	}
+	if (p < end) p++;						// skip the point
+	for (int d=0; d<decimals; d++) {		// fraction, padded with zeros
+		v *= 10;
+		if (p < end) {
+			if (*p < '0' || *p > '9') return false;
+			v += *p++ - '0';
+		}
+	}
+	for (; p < end; p++) {					// truncated digits still have to be digits
+		if (*p < '0' || *p > '9') return false;
+	}
+	value = negative ? -v : v;
+	return true;
+}	// END OF 'nmea_fixed'
+
+bool nmea_degrees(const nmea_field& field, const nmea_field& dir, long& udeg) {
+	long ddmm;
+	if (dir.len != 1 || !nmea_fixed(field, 5, ddmm) || ddmm < 0) return false;	// ddmm.mmmmm * 10^5, fits in 32 bits
+	long deg = ddmm / 10000000;
+	long min = ddmm % 10000000;				// minutes * 10^5
+	udeg = deg * 1000000 + (min + 3) / 6;	// minutes / 60 * 10^6 = (minutes * 10^5) / 6, rounded
+	char c = dir.ptr[0];
+	if (c == 'S' || c == 'W') udeg = -udeg;
+	else if (c != 'N' && c != 'E') return false;
+	return true;
+}	// END OF 'nmea_degrees'
+
+bool nmea_parse_rmc(const nmea_sentence& sentence, nmea_rmc& rmc) {
+	const nmea_field* f = sentence.fields;
+	if (sentence.count < 10 || f[0].len != 5 || memcmp(f[0].ptr + 2, "RMC", 3) != 0) return false;
+	rmc.valid = f[2].len == 1 && f[2].ptr[0] == 'A';
+	if (!rmc.valid) return true;		// the rest is probably empty, don't bother
+
+	if (f[1].len < 6 || f[9].len != 6) return false;
+	rmc.hour = digits(f[1].ptr, 2);
+	rmc.min = digits(f[1].ptr + 2, 2);
+	rmc.sec = digits(f[1].ptr + 4, 2);
+	rmc.day = digits(f[9].ptr, 2);
+	rmc.mon = digits(f[9].ptr + 2, 2);
+	rmc.year = digits(f[9].ptr + 4, 2);
+	if (rmc.hour < 0 || rmc.min < 0 || rmc.sec < 0 || rmc.day < 0 || rmc.mon < 0 || rmc.year < 0) return false;
+
+	if (!nmea_degrees(f[3], f[4], rmc.lat) || !nmea_degrees(f[5], f[6], rmc.lon)) return false;
+	if (!nmea_fixed(f[7], 2, rmc.speed)) rmc.speed = 0;		// some receivers leave these empty when stopped
+	if (!nmea_fixed(f[8], 2, rmc.course)) rmc.course = 0;
+	return true;
+}	// END OF 'nmea_parse_rmc'
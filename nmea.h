@@ -0,0 +1,71 @@
+// Streaming NMEA 0183 reader that splits sentences in place.
+
+#ifndef __NMEA_H__
+#define __NMEA_H__
+
+#define NMEA_MAX_SENTENCE 82	// longest legal sentence, including "$" and "*hh"
+#define NMEA_MAX_FIELDS 24		// fields kept per sentence, the address field included
+#define NMEA_BUFFER_SIZE 1024	// read buffer, holds several sentences per read()
+
+struct nmea_field {				// a field of a sentence, pointing into the reader's buffer
+	const char* ptr;
+	int len;
+};
+
+struct nmea_sentence {			// a checksummed sentence split into fields, field 0 is the address ("GPRMC")
+	nmea_field fields[NMEA_MAX_FIELDS];
+	int count;
+};
+
+// Serial data is read in chunks into 'buf'. Complete sentences are parsed
+// where they lie and only the trailing partial sentence is moved back to the
+// front, so a sentence's fields stay valid until the next nmea_next() or
+// nmea_read() call.
+struct nmea_reader {
+	char buf[NMEA_BUFFER_SIZE];
+	int fill;					// bytes of data in buf
+	int scan;					// start of the first unparsed line
+	unsigned long sentences;	// sentences that passed the checksum
+	unsigned long rejected;		// lines that were malformed or failed the checksum
+};
+
+struct nmea_rmc {				// the fields of an RMC sentence we care about
+	bool valid;					// status 'A', the receiver has a fix
+	int hour, min, sec;
+	int day, mon, year;			// mon is 1-12, year is 2 digits
+	long lat;					// micro-degrees, negative for S
+	long lon;					// micro-degrees, negative for W
+	long speed;					// knots * 100
+	long course;				// degrees * 100
+};
+
+void nmea_init(nmea_reader& reader);
+
+// Read whatever is waiting on 'fd' into the reader with a single read() call
+// and return its result.
+int nmea_read(nmea_reader& reader, int fd);
+
+// Get the next complete sentence out of the buffer. Returns false once only
+// a partial sentence (or nothing) is left.
+bool nmea_next(nmea_reader& reader, nmea_sentence& sentence);
+
+// Split one line ("$...*hh", without the line ending) into fields, checking
+// the checksum in the same pass. Returns false if the line is malformed or
+// the checksum doesn't match.
+bool nmea_parse(const char* line, int len, nmea_sentence& sentence);
+
+// Parse a decimal field into a fixed-point integer with 'decimals' digits
+// after the point, i.e. "4903.5" with 4 decimals is 49035000. Extra fraction
+// digits are truncated. Returns false if the field is empty or not a number.
+bool nmea_fixed(const nmea_field& field, int decimals, long& value);
+
+// Convert an NMEA ddmm.mmmmm position field and its N/S/E/W field to
+// micro-degrees (negative for S/W), rounded to the nearest. Returns false if
+// either is garbled.
+bool nmea_degrees(const nmea_field& field, const nmea_field& dir, long& udeg);
+
+// Pick an RMC sentence (any talker) apart. Returns false if this isn't one or
+// it is too short or garbled.
+bool nmea_parse_rmc(const nmea_sentence& sentence, nmea_rmc& rmc);
+
+#endif  // __NMEA_H__
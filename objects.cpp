@@ -0,0 +1,134 @@
+// APRS objects and items, each beaconed at its own rate off a timing wheel.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "ax25.h"
+#include "aprs.h"
+#include "nmea.h"
+#include "objects.h"
+
+using std::string;
+
+static string next_token(const string& line, size_t& pos) {	// next whitespace separated word of 'line'
+	size_t start = line.find_first_not_of(" \t", pos);
+	if (start == string::npos) {
+		pos = line.length();
+		return "";
+	}
+	pos = line.find_first_of(" \t", start);
+	if (pos == string::npos) pos = line.length();
+	return line.substr(start, pos - start);
+}
+
+static bool to_udeg(const string& text, long limit, long& udeg) {	// signed decimal degrees to micro-degrees
+	nmea_field field = {text.c_str(), (int)text.length()};
+	return nmea_fixed(field, 6, udeg) && udeg >= -limit * 1000000 && udeg <= limit * 1000000;
+}
+
+bool objects_load(object_list& list, const char* path) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "OBJECTS: Could not open %s\n", path);
+		return false;
+	}
+	char buff[512];
+	int line_no = 0;
+	bool ok = true;
+	while (fgets(buff, sizeof(buff), file) != NULL) {
+		line_no++;
+		string line = buff;
+		size_t end = line.find_last_not_of(" \t\r\n");
+		if (end == string::npos || line[line.find_first_not_of(" \t")] == '#') continue;	// blank or comment
+		line.erase(end + 1);
+
+		size_t pos = 0;
+		aprs_object object;
+		string name = next_token(line, pos);
+		string type = next_token(line, pos);
+		string rate = next_token(line, pos);
+		string lat = next_token(line, pos);
+		string lon = next_token(line, pos);
+		string symbol = next_token(line, pos);
+		size_t comment = line.find_first_not_of(" \t", pos);
+		if (comment != string::npos) object.comment = line.substr(comment);
+
+		object.item = type == "item";
+		object.rate = rate.find_first_not_of("0123456789") == string::npos && rate.length() <= 8 ? atoi(rate.c_str()) : 0;	// whole seconds only
+		if (name.length() < (object.item ? 3 : 1) || name.length() > 9) {
+			fprintf(stderr, "OBJECTS: %s:%i: Name must be %s to 9 characters.\n", path, line_no, object.item ? "3" : "1");
+			ok = false;
+		} else if (type != "object" && type != "item") {
+			fprintf(stderr, "OBJECTS: %s:%i: Type must be 'object' or 'item'.\n", path, line_no);
+			ok = false;
+		} else if (object.rate <= 0 || object.rate >= 1 << (WHEEL_BITS * WHEEL_LEVELS)) {	// the wheel's span, about 194 days
+			fprintf(stderr, "OBJECTS: %s:%i: Rate must be a number of seconds, 1 to %i.\n", path, line_no, (1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1);
+			ok = false;
+		} else if (!to_udeg(lat, 90, object.lat) || !to_udeg(lon, 180, object.lon)) {
+			fprintf(stderr, "OBJECTS: %s:%i: Position must be decimal degrees.\n", path, line_no);
+			ok = false;
+		} else if (symbol.length() != 2) {
+			fprintf(stderr, "OBJECTS: %s:%i: Symbol must be a table and a code, like /_\n", path, line_no);
+			ok = false;
+		} else {
+			strcpy(object.name, name.c_str());
+			object.table = symbol[0];
+			object.symbol = symbol[1];
+			list.objects.push_back(object);
+		}
+	}
+	fclose(file);
+	return ok;
+}	// END OF 'objects_load'
+
+void objects_start(object_list& list, unsigned long tick) {
+	int count = list.objects.size();
+	wheel_init(list.wheel, count, tick);
+	list.queue = new int[count];
+	list.queued = new bool[count];
+	list.queue_head = 0;
+	list.queue_len = 0;
+	list.dropped = 0;
+	for (int i=0;i<count;i++) {
+		list.queued[i] = false;
+		wheel_schedule(list.wheel, i, tick + 1 + i % list.objects[i].rate);	// stagger the first round
+	}
+}	// END OF 'objects_start'
+
+void objects_tick(object_list& list, unsigned long tick) {
+	wheel_advance(list.wheel, tick);
+	int id;
+	while ((id = wheel_pop(list.wheel)) != -1) {
+		wheel_schedule(list.wheel, id, tick + list.objects[id].rate);	// keep the rate steady even if sending lags
+		if (list.queued[id]) {
+			list.dropped++;
+			continue;
+		}
+		list.queue[(list.queue_head + list.queue_len) % list.objects.size()] = id;	// can't overflow, each object is queued once at most
+		list.queue_len++;
+		list.queued[id] = true;
+	}
+}	// END OF 'objects_tick'
+
+int objects_next(object_list& list) {
+	if (list.queue_len == 0) return -1;
+	int id = list.queue[list.queue_head];
+	list.queue_head = (list.queue_head + 1) % list.objects.size();
+	list.queue_len--;
+	list.queued[id] = false;
+	return id;
+}	// END OF 'objects_next'
+
+int object_report(char* out, const aprs_object& object, const struct tm& time) {
+	int len;
+	if (object.item) {
+		len = sprintf(out, ")%s!", object.name);
+	} else {
+		len = sprintf(out, ";%-9s*%02i%02i%02iz", object.name, time.tm_mday, time.tm_hour, time.tm_min);	// live object, DHM timestamp
+	}
+	len += aprs_position(out + len, object.lat, object.lon, object.table, object.symbol);
+	int comment_len = object.comment.length();
+	if (comment_len > AX25_MAX_INFO - len) comment_len = AX25_MAX_INFO - len;
+	memcpy(out + len, object.comment.c_str(), comment_len);
+	return len + comment_len;
+}	// END OF 'object_report'
@@ -0,0 +1,58 @@
+// APRS objects and items, each beaconed at its own rate off a timing wheel.
+
+#ifndef __OBJECTS_H__
+#define __OBJECTS_H__
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include "wheel.h"
+
+struct aprs_object {
+	char name[10];				// 3-9 chars, null terminated
+	bool item;					// send as an item instead of an object
+	int rate;					// seconds between reports
+	long lat;					// latitude, micro-degrees, negative for S
+	long lon;					// longitude, micro-degrees, negative for W
+	char table;					// symbol table
+	char symbol;				// symbol code
+	std::string comment;
+};
+
+// The objects to send, the wheel that says when each is due, and the queue
+// of reports waiting to go out. One wheel tick is one second.
+struct object_list {
+	std::vector<aprs_object> objects;
+	timing_wheel wheel;
+	int* queue;					// ring of object indices waiting to be sent
+	int queue_head;
+	int queue_len;
+	bool* queued;				// is this object already waiting in the queue?
+	unsigned long dropped;		// reports skipped because the last one hadn't gone out yet
+};
+
+// Load objects from 'path', one per line:
+//
+//   name  object|item  rate  lat  lon  symbol  comment...
+//
+// lat/lon in signed decimal degrees, symbol as table and code ("/_"). Blank
+// lines and lines starting with '#' are skipped. Prints what's wrong and
+// returns false on any bad line.
+bool objects_load(object_list& list, const char* path);
+
+// Set up the wheel and queue, spreading first reports over each object's
+// rate so they don't all go out on the same tick.
+void objects_start(object_list& list, unsigned long tick);
+
+// Turn the wheel to 'tick', queueing everything that came due and
+// rescheduling it.
+void objects_tick(object_list& list, unsigned long tick);
+
+// Take the next object off the queue, or -1 if it's empty.
+int objects_next(object_list& list);
+
+// Write the report for 'object' into 'out' (room for AX25_MAX_INFO bytes),
+// stamped with 'time' (UTC). Returns the payload length.
+int object_report(char* out, const aprs_object& object, const struct tm& time);
+
+#endif  // __OBJECTS_H__
@@ -0,0 +1,171 @@
+// Raw serial port transport with a non-blocking outbound queue.
+
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include "serial.h"
+
+int serial_baud_code(int baud) {		// return a baudrate code from the baudrate int
+	switch (baud) {
+	case 0:
+		return B0;
+	case 50:
+		return B50;
+	case 75:
+		return B75;
+	case 100:
+		return B110;
+	case 134:
+		return B134;
+	case 150:
+		return B150;
+	case 200:
+		return B200;
+	case 300:
+		return B300;
+	case 600:
+		return B600;
+	case 1200:
+		return B1200;
+	case 1800:
+		return B1800;
+	case 2400:
+		return B2400;
+	case 4800:
+		return B4800;
+	case 9600:
+		return B9600;
+	case 19200:
+		return B19200;
+	case 38400:
+		return B38400;
+	case 57600:
+		return B57600;
+	case 115200:
+		return B115200;
+	case 230400:
+		return B230400;
+	default:
+		return -1;
+	}
+}	// END OF 'serial_baud_code'
+
+bool serial_open(serial_port& port, const char* path, int baud, bool nonblocking) {
+	port.fd = -1;
+	port.baud = baud;
+	port.queue = new unsigned char[SERIAL_QUEUE_SIZE];
+	port.head = 0;
+	port.len = 0;
+	port.queued = 0;
+	port.written = 0;
+	port.dropped = 0;
+	port.errors = 0;
+
+	int baud_code = serial_baud_code(baud);
+	if (baud_code == -1 || baud == 0) return false;
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);	// don't hang waiting for carrier
+	if (fd == -1) return false;
+	struct termios options;
+	if (tcgetattr(fd, &options) == -1) {
+		close(fd);
+		return false;
+	}
+	cfmakeraw(&options);									// 8 bit, no parity, no translation or line editing either way
+	cfsetispeed(&options, baud_code);
+	cfsetospeed(&options, baud_code);
+	options.c_cflag &= ~(CSTOPB | CRTSCTS);					// 1 stop bit, no hardware flow control
+	options.c_cflag |= CLOCAL | CREAD;						// ignore modem lines, enable the receiver
+	options.c_cc[VMIN] = nonblocking ? 0 : 1;				// see serial.h
+	options.c_cc[VTIME] = nonblocking ? 0 : 1;
+	if (tcsetattr(fd, TCSANOW, &options) == -1) {
+		close(fd);
+		return false;
+	}
+	if (!nonblocking) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+	tcflush(fd, TCIOFLUSH);									// drop whatever was sitting in the buffers
+	port.fd = fd;
+	return true;
+}	// END OF 'serial_open'
+
+void serial_close(serial_port& port) {
+	if (port.fd != -1) close(port.fd);
+	port.fd = -1;
+	port.len = 0;
+}	// END OF 'serial_close'
+
+static int write_some(serial_port& port, const struct iovec* iov, int count) {	// one writev, -1 on a real error
+	ssize_t n;
+	do {
+		n = writev(port.fd, iov, count);
+	} while (n == -1 && errno == EINTR);
+	if (n == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;	// port is full, try again on EPOLLOUT
+		port.errors++;
+		return -1;
+	}
+	port.written += n;
+	return n;
+}
+
+long long serial_writev(serial_port& port, const struct iovec* iov, int count, long long now) {
+	if (port.fd == -1) return -1;
+	int len = 0;
+	for (int i=0;i<count;i++) len += iov[i].iov_len;
+	if (len > SERIAL_QUEUE_SIZE - port.len) {				// no room, drop the whole batch rather than part of a frame
+		port.dropped += count;
+		return -1;
+	}
+	int sent = 0;
+	if (port.len == 0) {									// nothing ahead of us, skip the queue
+		sent = write_some(port, iov, count);
+		if (sent == -1) return -1;
+	}
+	int skip = sent;										// queue what the port didn't take
+	for (int i=0;i<count;i++) {
+		int n = iov[i].iov_len;
+		if (skip >= n) {
+			skip -= n;
+			continue;
+		}
+		const unsigned char* data = (const unsigned char*)iov[i].iov_base + skip;
+		n -= skip;
+		skip = 0;
+		int tail = (port.head + port.len) % SERIAL_QUEUE_SIZE;
+		int first = n < SERIAL_QUEUE_SIZE - tail ? n : SERIAL_QUEUE_SIZE - tail;
+		memcpy(port.queue + tail, data, first);
+		memcpy(port.queue, data + first, n - first);
+		port.len += n;
+	}
+	port.queued += len;
+
+	int outq = 0;											// what the kernel still holds for the port
+	if (ioctl(port.fd, TIOCOUTQ, &outq) == -1) outq = 0;
+	return now + (outq + port.len) * 10000LL / port.baud;	// 10 bits a byte at 8N1
+}	// END OF 'serial_writev'
+
+bool serial_flush(serial_port& port) {
+	while (port.len > 0) {
+		struct iovec iov[2];								// the ring may wrap, write both halves at once
+		int first = port.len < SERIAL_QUEUE_SIZE - port.head ? port.len : SERIAL_QUEUE_SIZE - port.head;
+		iov[0].iov_base = port.queue + port.head;
+		iov[0].iov_len = first;
+		iov[1].iov_base = port.queue;
+		iov[1].iov_len = port.len - first;
+		int n = write_some(port, iov, port.len > first ? 2 : 1);
+		if (n == -1) {									// the port won't take it, so don't keep asking
+			port.len = 0;
+			port.head = 0;
+			return false;
+		}
+		if (n == 0) break;
+		port.head = (port.head + n) % SERIAL_QUEUE_SIZE;
+		port.len -= n;
+	}
+	if (port.len == 0) port.head = 0;
+	return true;
+}	// END OF 'serial_flush'
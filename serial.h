@@ -0,0 +1,51 @@
+// Raw serial port transport with a non-blocking outbound queue.
+
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+
+#include <sys/uio.h>
+
+#define SERIAL_QUEUE_SIZE 8192	// outbound bytes held while the port can't keep up
+
+// A serial port opened raw (8N1, no translation, no line editing). Writes go
+// straight to the port when nothing is waiting, and whatever the kernel won't
+// take is kept in a ring and written as the port drains (EPOLLOUT), so a slow
+// TNC never blocks us and frames are never cut short. A batch is queued
+// whole or not at all.
+struct serial_port {
+	int fd;
+	int baud;					// line rate, for drain estimates
+	unsigned char* queue;		// ring of bytes waiting to go out
+	int head;					// first waiting byte
+	int len;					// bytes waiting, the port needs EPOLLOUT while this isn't 0
+	unsigned long long queued;	// bytes accepted so far
+	unsigned long long written;	// bytes handed to the kernel so far
+	unsigned long dropped;		// frames that didn't fit in the queue
+	unsigned long errors;		// write errors other than EAGAIN
+};
+
+// Return the termios code for a baud rate, or -1 if there isn't one.
+int serial_baud_code(int baud);
+
+// Open 'path' raw at 'baud'. A non-blocking port returns from read() with
+// whatever is there (VMIN 0, VTIME 0) and is meant for an epoll loop. A
+// blocking one waits for data and returns once the line goes quiet for a
+// tenth of a second (VMIN 1, VTIME 1), so a reader thread gets whole bursts.
+// Returns false if the port can't be opened or the baud rate is invalid.
+bool serial_open(serial_port& port, const char* path, int baud, bool nonblocking);
+
+void serial_close(serial_port& port);
+
+// Send a batch of frames with one writev(): write what the port takes now
+// and queue the rest. Returns an estimate of when (monotonic ms, from 'now')
+// the last byte leaves the port, counting what the kernel and our queue
+// already hold, or -1 if the batch was dropped because the queue is full or
+// the port failed.
+long long serial_writev(serial_port& port, const struct iovec* iov, int count, long long now);
+
+// Write as much of the queue as the port takes. Call it when epoll says the
+// port is writable. Returns false on a write error other than EAGAIN, after
+// discarding the queue.
+bool serial_flush(serial_port& port);
+
+#endif  // __SERIAL_H__
@@ -0,0 +1,54 @@
+// SmartBeaconing(tm) from HamHUD.net, see http://www.hamhud.net/hh2/smartbeacon.html
+
+#include <cstdlib>
+#include "smartbeacon.h"
+
+void sb_reset(smartbeacon& sb) {
+	sb.last_beacon = -1;
+	sb.last_hdg = 0;
+	sb.rate = sb.static_rate;
+	sb.turn_threshold = 0;
+	sb.hdg_change = 0;
+	sb.scale = 100;
+	sb.reason = SB_STARTUP;
+}	// END OF 'sb_reset'
+
+long long sb_update(smartbeacon& sb, float speed, int hdg, long long now) {
+	if (sb.last_beacon < 0) {				// send startup beacon
+		sb.reason = SB_STARTUP;
+		return now;
+	}
+	sb.reason = SB_RATE;
+	if (sb.static_rate != 0) {
+		sb.rate = sb.static_rate * sb.scale / 100;
+		return sb.last_beacon + sb.rate * 1000LL;
+	}
+
+	speed *= 1.15078;						// convert knots to mph
+	if (speed < sb.low_speed) {
+		sb.rate = sb.low_rate;
+	} else if (speed > sb.high_speed) {
+		sb.rate = sb.high_rate;
+	} else {
+		sb.rate = sb.high_rate * sb.high_speed / speed;
+	}
+	sb.rate = sb.rate * sb.scale / 100;		// back off on a busy channel
+	long long due = sb.last_beacon + sb.rate * 1000LL;
+
+	sb.hdg_change = (hdg - sb.last_hdg + 540) % 360 - 180;	// shortest way around, so 359 -> 1 is 2 degrees
+	if (speed > 0) {						// can't corner peg if we aren't going anywhere
+		sb.turn_threshold = sb.turn_min + sb.turn_slope / speed;
+		long long turn_ok = sb.last_beacon + sb.turn_time * sb.scale * 10LL;	// turn_time * 1000 * scale / 100
+		if (abs(sb.hdg_change) > sb.turn_threshold && now > turn_ok && due > now) {
+			due = now;
+			sb.reason = SB_TURN;
+		}
+	}
+	return due;
+}	// END OF 'sb_update'
+
+void sb_beacon_sent(smartbeacon& sb, int hdg, long long now) {
+	sb.last_beacon = now;
+	sb.last_hdg = hdg;
+	sb.hdg_change = 0;
+}	// END OF 'sb_beacon_sent'
@@ -0,0 +1,45 @@
+// SmartBeaconing(tm) from HamHUD.net, see http://www.hamhud.net/hh2/smartbeacon.html
+
+#ifndef __SMARTBEACON_H__
+#define __SMARTBEACON_H__
+
+enum sb_reason {				// why a beacon is due
+	SB_STARTUP,					// nothing sent yet
+	SB_RATE,					// the rate for our speed, or the static rate, ran out
+	SB_TURN						// corner pegging
+};
+
+struct smartbeacon {
+	// settings, from the [beacon] section of the config
+	int static_rate;			// fixed beacon rate in seconds, 0 for SmartBeaconing
+	int low_speed;				// low threshold, in mph
+	int low_rate;				// rate below low_speed, in seconds
+	int high_speed;				// high threshold, in mph
+	int high_rate;				// rate above high_speed, in seconds
+	int turn_min;				// turn minimum, in degrees
+	int turn_time;				// turn time (minimum), in seconds
+	int turn_slope;				// turn slope
+
+	// state, all times in milliseconds on the caller's clock
+	long long last_beacon;		// when the last beacon went out, -1 before the first one
+	int last_hdg;				// heading at the last beacon
+	int rate;					// current beacon rate, in seconds
+	float turn_threshold;		// current corner pegging threshold, in degrees
+	int hdg_change;				// heading change since the last beacon
+	int scale;					// percent to stretch rate and turn_time by, set by the caller, 100 is as configured
+	sb_reason reason;			// what the due time from the last sb_update() comes from
+};
+
+// Forget any beacon history, so the next sb_update() says a beacon is due.
+void sb_reset(smartbeacon& sb);
+
+// Update the rate and turn threshold for the current speed (knots) and
+// heading, both stretched by 'scale', and return when the next beacon is due. A return value <= 'now'
+// means send one now; a turn sharper than the threshold makes it due right
+// away once turn_time has passed since the last beacon.
+long long sb_update(smartbeacon& sb, float speed, int hdg, long long now);
+
+// Record that a beacon was just sent at heading 'hdg'.
+void sb_beacon_sent(smartbeacon& sb, int hdg, long long now);
+
+#endif  // __SMARTBEACON_H__
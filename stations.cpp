@@ -0,0 +1,263 @@
+// Last heard station table with a grid index for "who's near" queries.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "stations.h"
+
+static int home_slot(const station_db& db, unsigned long long key) {	// callsign bits are far from random, mix them first
+	return (key * 0x9E3779B97F4A7C15ULL) >> 32 & db.mask;
+}
+
+static void unindex(station_db& db, int index) {	// take a station out of the hash table
+	int i = home_slot(db, db.keys[index]);
+	while (db.table[i] != index) {
+		if (db.table[i] == -1) return;
+		i = (i + 1) & db.mask;
+	}
+	int j = i;
+	while (true) {								// shift later entries back into the hole, as in the dupe filter
+		j = (j + 1) & db.mask;
+		if (db.table[j] == -1) break;
+		int home = home_slot(db, db.keys[db.table[j]]);
+		if (((j - home) & db.mask) >= ((j - i) & db.mask)) {
+			db.table[i] = db.table[j];
+			i = j;
+		}
+	}
+	db.table[i] = -1;
+}
+
+static void unlink_cell(station_db& db, int i) {
+	if (db.cell[i] == -1) return;
+	if (db.prev[i] != -1) db.next[db.prev[i]] = db.next[i];
+	else db.grid[db.cell[i]] = db.next[i];
+	if (db.next[i] != -1) db.prev[db.next[i]] = db.prev[i];
+	db.cell[i] = -1;
+}
+
+static void link_cell(station_db& db, int i, int cell) {
+	db.cell[i] = cell;
+	db.prev[i] = -1;
+	db.next[i] = db.grid[cell];
+	if (db.next[i] != -1) db.prev[db.next[i]] = i;
+	db.grid[cell] = i;
+}
+
+static int row_of(long lat) {
+	int row = (lat + 90000000L) / 1000000L;
+	return row < 0 ? 0 : row >= STATION_ROWS ? STATION_ROWS - 1 : row;
+}
+
+static int col_of(long lon) {
+	int col = (lon + 180000000L) / 1000000L;
+	return col < 0 ? 0 : col >= STATION_COLS ? STATION_COLS - 1 : col;
+}
+
+static int add_station(station_db& db, unsigned long long key) {
+	int i;
+	if (db.count < db.capacity) {
+		i = db.count++;
+	} else {									// full: forget the stalest of a few picked at random
+		i = -1;
+		for (int s=0;s<STATION_SAMPLE;s++) {
+			db.random ^= db.random << 13;		// xorshift32
+			db.random ^= db.random >> 17;
+			db.random ^= db.random << 5;
+			int pick = db.random % db.capacity;
+			if (i == -1 || db.heard[pick] < db.heard[i]) i = pick;
+		}
+		unindex(db, i);
+		unlink_cell(db, i);
+		db.evicted++;
+	}
+	db.keys[i] = key;
+	db.flags[i] = 0;
+	db.lat[i] = 0;
+	db.lon[i] = 0;
+	db.table_char[i] = 0;
+	db.symbol[i] = 0;
+	db.path_len[i] = 0;
+	int slot = home_slot(db, key);
+	while (db.table[slot] != -1) slot = (slot + 1) & db.mask;
+	db.table[slot] = i;
+	return i;
+}
+
+// Call 'visit(index, squared distance in degrees)' for every station with a
+// position within 'km' of lat/lon, looking only at the grid cells the circle
+// overlaps. Distances are flat earth, plenty for the few hundred km anyone
+// asks about.
+template <typename F>
+static void scan(const station_db& db, long lat, long lon, int km, F visit) {
+	float deg = km / STATION_KM_PER_DEGREE;
+	long reach = deg * 1000000L;
+	int row0 = row_of(lat - reach);
+	int row1 = row_of(lat + reach);
+	float widest = std::max(fabsf(row0 - 90.0f), fabsf(row1 + 1 - 90.0f));	// the circle is widest in degrees of longitude there
+	float narrow = cosf(std::min(widest, 90.0f) * (float)M_PI / 180);
+	int col0 = 0, cols = STATION_COLS;
+	if (narrow > 0.01f && deg / narrow < 180) {
+		long lon_reach = deg / narrow * 1000000L;
+		col0 = (lon - lon_reach + 180000000L) / 1000000L;
+		int col1 = (lon + lon_reach + 180000000L) / 1000000L;
+		if (lon - lon_reach + 180000000L < 0) col0--;		// round down, not towards 0
+		cols = std::min(col1 - col0 + 1, STATION_COLS);
+		col0 = (col0 % STATION_COLS + STATION_COLS) % STATION_COLS;
+	}
+	float scale = cosf(lat / 1e6f * (float)M_PI / 180);
+	float limit = deg * deg;
+	for (int row=row0;row<=row1;row++) {
+		for (int k=0;k<cols;k++) {
+			int cell = row * STATION_COLS + (col0 + k) % STATION_COLS;
+			for (int i=db.grid[cell];i!=-1;i=db.next[i]) {
+				float dlat = (db.lat[i] - lat) / 1e6f;
+				long dlon_u = db.lon[i] - lon;
+				if (dlon_u > 180000000L) dlon_u -= 360000000L;		// the short way round
+				else if (dlon_u < -180000000L) dlon_u += 360000000L;
+				float dlon = dlon_u / 1e6f * scale;
+				float d2 = dlat * dlat + dlon * dlon;
+				if (d2 <= limit) visit(i, d2);
+			}
+		}
+	}
+}
+
+void station_init(station_db& db, int capacity) {
+	int size = 1;
+	while (size < capacity * 2) size <<= 1;		// keep the table at most half full
+	db.table = new int[size];
+	for (int i=0;i<size;i++) db.table[i] = -1;
+	db.mask = size - 1;
+	db.capacity = capacity;
+	db.count = 0;
+	db.keys = new unsigned long long[capacity];
+	db.lat = new int[capacity];
+	db.lon = new int[capacity];
+	db.heard = new long long[capacity];
+	db.flags = new unsigned char[capacity];
+	db.table_char = new char[capacity];
+	db.symbol = new char[capacity];
+	db.path = new unsigned long long[capacity * AX25_MAX_DIGIS];
+	db.path_len = new unsigned char[capacity];
+	db.cell = new int[capacity];
+	db.next = new int[capacity];
+	db.prev = new int[capacity];
+	for (int i=0;i<capacity;i++) db.cell[i] = -1;
+	db.grid = new int[STATION_ROWS * STATION_COLS];
+	for (int i=0;i<STATION_ROWS*STATION_COLS;i++) db.grid[i] = -1;
+	db.random = 2463534242U;
+	db.updates = 0;
+	db.evicted = 0;
+}	// END OF 'station_init'
+
+unsigned long long station_key(const unsigned char* address) {
+	unsigned long long key = 0;
+	for (int i=0;i<6;i++) key = key << 8 | address[i];
+	return key << 8 | (address[6] & 0x1E);		// just the SSID
+}	// END OF 'station_key'
+
+int station_call(char* out, unsigned long long key) {
+	unsigned char address[AX25_ADDR_LEN];
+	for (int i=AX25_ADDR_LEN-1;i>=0;i--) {
+		address[i] = key & 0xFF;
+		key >>= 8;
+	}
+	return ax25_address_text(out, address);
+}	// END OF 'station_call'
+
+int station_find(const station_db& db, unsigned long long key) {
+	int slot = home_slot(db, key);
+	while (db.table[slot] != -1) {
+		if (db.keys[db.table[slot]] == key) return db.table[slot];
+		slot = (slot + 1) & db.mask;
+	}
+	return -1;
+}	// END OF 'station_find'
+
+static bool generic_alias(const unsigned char* addr) {	// WIDEn-N, RELAY and the like: any digi may answer to them
+	static const char* aliases[] = {"WIDE", "TRACE", "TEMP", "RELAY", "GATE", "ECHO"};
+	char call[7];
+	int len = 0;
+	while (len < 6 && addr[len] >> 1 != ' ') {
+		call[len] = addr[len] >> 1;
+		len++;
+	}
+	if (len > 0 && call[len-1] >= '1' && call[len-1] <= '7') len--;	// the n of WIDEn-N
+	call[len] = 0;
+	for (unsigned i=0;i<sizeof(aliases)/sizeof(aliases[0]);i++) {
+		if (strcmp(call, aliases[i]) == 0) return true;
+	}
+	return false;
+}
+
+int station_heard(station_db& db, const ax25_frame& frame, const aprs_packet* packet, long long now) {
+	unsigned long long path[AX25_MAX_DIGIS];
+	for (int d=0;d<frame.digis;d++) {			// digis first, so adding one can't evict the source we're about to fill in
+		path[d] = station_key(frame.via[d]);
+		if (!(frame.via[d][6] & 0x80)) continue;	// H bit: this one repeated it
+		if (!generic_alias(frame.via[d])) {		// a used up alias doesn't say who repeated it
+			int v = station_find(db, path[d]);
+			if (v == -1) v = add_station(db, path[d]);
+			db.flags[v] |= STATION_DIGI;
+			db.heard[v] = now;					// it was on the air just now
+		}
+		path[d] |= STATION_REPEATED;
+	}
+
+	unsigned long long key = station_key(frame.source);
+	int i = station_find(db, key);
+	if (i == -1) i = add_station(db, key);
+	db.heard[i] = now;
+	memcpy(db.path + (long)i * AX25_MAX_DIGIS, path, frame.digis * sizeof(path[0]));
+	db.path_len[i] = frame.digis;
+	if (packet != NULL && packet->has_position) {
+		db.lat[i] = packet->lat;
+		db.lon[i] = packet->lon;
+		db.table_char[i] = packet->table;
+		db.symbol[i] = packet->symbol;
+		db.flags[i] |= STATION_HAS_POSITION;
+		if (packet->symbol == '#') db.flags[i] |= STATION_DIGI;
+		int cell = row_of(packet->lat) * STATION_COLS + col_of(packet->lon);
+		if (cell != db.cell[i]) {
+			unlink_cell(db, i);
+			link_cell(db, i, cell);
+		}
+	}
+	db.updates++;
+	return i;
+}	// END OF 'station_heard'
+
+int station_within(const station_db& db, long lat, long lon, int km, int* out, int max) {
+	int count = 0;
+	scan(db, lat, lon, km, [&](int i, float) {
+		if (count < max) out[count] = i;
+		count++;
+	});
+	return count;
+}	// END OF 'station_within'
+
+int station_nearest_digi(const station_db& db, long lat, long lon, int km) {
+	int best = -1;
+	float best_d2 = 0;
+	for (int radius = std::min(km, 25); best == -1; radius *= 2) {	// small circles first, most of the time there's one close by
+		if (radius > km) radius = km;
+		scan(db, lat, lon, radius, [&](int i, float d2) {
+			if ((db.flags[i] & STATION_DIGI) && (best == -1 || d2 < best_d2)) {
+				best = i;
+				best_d2 = d2;
+			}
+		});
+		if (radius == km) break;
+	}
+	return best;
+}	// END OF 'station_nearest_digi'
+
+float station_distance(const station_db& db, int index, long lat, long lon) {
+	float dlat = (db.lat[index] - lat) / 1e6f;
+	long dlon_u = db.lon[index] - lon;
+	if (dlon_u > 180000000L) dlon_u -= 360000000L;
+	else if (dlon_u < -180000000L) dlon_u += 360000000L;
+	float dlon = dlon_u / 1e6f * cosf((db.lat[index] + lat) / 2e6f * (float)M_PI / 180);
+	return sqrtf(dlat * dlat + dlon * dlon) * STATION_KM_PER_DEGREE;
+}	// END OF 'station_distance'
@@ -0,0 +1,83 @@
+// Last heard station table with a grid index for "who's near" queries.
+
+#ifndef __STATIONS_H__
+#define __STATIONS_H__
+
+#include "aprs.h"
+#include "ax25.h"
+
+#define STATION_ROWS 180		// grid of 1 degree cells
+#define STATION_COLS 360
+#define STATION_SAMPLE 8		// entries looked at to pick one to evict when full
+#define STATION_KM_PER_DEGREE 111.195f
+
+#define STATION_HAS_POSITION 1	// flags
+#define STATION_DIGI 2			// heard repeating, or has a digipeater symbol
+#define STATION_REPEATED (1ULL << 63)	// on a path key, that via has repeated the frame
+
+// Stations are keyed by their AX.25 address packed into a 64 bit integer
+// (the 6 shifted callsign bytes and the SSID, flag bits dropped), so
+// interning a source address is a shift and an or per byte, no text.
+//
+// Entries are a structure of arrays, one index per station, so a query
+// walking candidates only touches the positions and flags. An open
+// addressing table (linear probing, like the dupe filter) maps keys to
+// indexes. Stations with a position are also linked into a list per grid
+// cell; a query visits only the cells its circle overlaps. Everything is
+// sized once by station_init(). When full, the least recently heard of a
+// few random entries makes room, which is close to LRU without keeping an
+// order up to date on every packet.
+struct station_db {
+	int capacity;
+	int count;					// entries in use, 0 to count-1
+	int* table;					// hash table of indexes, -1 for empty
+	int mask;					// table size - 1, the size is a power of two
+	unsigned long long* keys;
+	int* lat;					// micro-degrees, negative for S
+	int* lon;					// micro-degrees, negative for W
+	long long* heard;			// ms
+	unsigned char* flags;
+	char* table_char;			// symbol table and symbol
+	char* symbol;
+	unsigned long long* path;	// AX25_MAX_DIGIS per station, keys with STATION_REPEATED
+	unsigned char* path_len;
+	int* cell;					// grid cell, -1 without a position
+	int* next;					// grid cell list
+	int* prev;
+	int* grid;					// first station in each cell, -1 if none
+	unsigned int random;		// for picking eviction candidates
+	unsigned long updates;
+	unsigned long evicted;
+};
+
+// Allocate room for 'capacity' stations.
+void station_init(station_db& db, int capacity);
+
+// The key for a 7 byte AX.25 address.
+unsigned long long station_key(const unsigned char* address);
+
+// Write "CALL-SSID" for a key into 'out' (at least 10 bytes). Returns the
+// text length.
+int station_call(char* out, unsigned long long key);
+
+// Index of a station, or -1 if it hasn't been heard.
+int station_find(const station_db& db, unsigned long long key);
+
+// Note a frame heard from its source at 'now' (ms): its path, and its
+// position and symbol if the payload had one ('packet' may be NULL). Vias
+// that repeated it are marked as digipeaters. O(1) amortized. Returns the
+// station's index.
+int station_heard(station_db& db, const ax25_frame& frame, const aprs_packet* packet, long long now);
+
+// Stations with a position within 'km' of lat/lon (micro-degrees), up to
+// 'max' indexes into 'out'. Returns how many there are, which may be more
+// than 'max'.
+int station_within(const station_db& db, long lat, long lon, int km, int* out, int max);
+
+// The nearest digipeater to lat/lon within 'km', or -1 if there isn't one.
+int station_nearest_digi(const station_db& db, long lat, long lon, int km);
+
+// Distance from lat/lon to a station, in km.
+float station_distance(const station_db& db, int index, long lat, long lon);
+
+#endif  // __STATIONS_H__
@@ -0,0 +1,71 @@
+// Test: a million random positions through each encoder and back through aprs_decode().
+//
+//	ctest --test-dir build -R aprs_test
+//
+// Positions must come back within half the format's resolution: a
+// hundredth of a minute (167 micro-degrees) uncompressed and in Mic-E, and
+// one base91 step (under 6 micro-degrees) compressed. Speed and course must
+// come back as the format rounds them.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../aprs.h"
+
+#define POSITIONS 1000000
+
+static unsigned long failures = 0;
+
+static void fail(const char* format, int i, long lat, long lon, const char* got, int len) {
+	if (failures++ < 10) fprintf(stderr, "%s: position %i (%li, %li) came back wrong from \"%.*s\"\n", format, i, lat, lon, len, got);
+}
+
+static bool near(long a, long b, long tolerance) {
+	return labs(a - b) <= tolerance;
+}
+
+static int knots(int speed) {					// hundredths of a knot to whole knots, as Mic-E sends it
+	int kn = (speed + 50) / 100;
+	return kn > 799 ? 799 : kn;
+}
+
+int main() {
+	srand(1);
+	long worst[3] = {0, 0, 0};					// largest position error seen per format
+	for (int i=0;i<POSITIONS;i++) {
+		long lat = (long)(rand() % 179999999) - 89999999;
+		long lon = (long)(rand() % 359999999) - 179999999;
+		int speed = rand() % 80000;
+		int course = rand() % 360;
+		char info[64];
+		char destination[7] = "APRS";
+		aprs_packet packet;
+
+		info[0] = '!';
+		int len = 1 + aprs_position(info + 1, lat, lon, '/', '>');
+		if (!aprs_decode(destination, 4, info, len, packet) || packet.type != APRS_POSITION || packet.format != APRS_UNCOMPRESSED
+			|| !near(packet.lat, lat, 84) || !near(packet.lon, lon, 84)) {
+			fail("uncompressed", i, lat, lon, info, len);
+		}
+		if (labs(packet.lat - lat) > worst[0]) worst[0] = labs(packet.lat - lat);
+
+		info[0] = '!';
+		len = 1 + aprs_compressed(info + 1, lat, lon, speed, course, '/', '>');
+		if (!aprs_decode(destination, 4, info, len, packet) || packet.type != APRS_POSITION || packet.format != APRS_COMPRESSED
+			|| !near(packet.lat, lat, 6) || !near(packet.lon, lon, 6)
+			|| packet.course != course / 4 * 4 || !near(packet.speed, speed, speed * 4 / 100 + 50)) {	// 1.08^s steps, nearest
+			fail("compressed", i, lat, lon, info, len);
+		}
+		if (labs(packet.lat - lat) > worst[1]) worst[1] = labs(packet.lat - lat);
+
+		len = aprs_mice(destination, info, lat, lon, speed, course, '/', '>', MICE_EN_ROUTE);
+		if (!aprs_decode(destination, 6, info, len, packet) || packet.type != APRS_POSITION || packet.format != APRS_MICE
+			|| !near(packet.lat, lat, 84) || !near(packet.lon, lon, 84) || packet.mice_message != MICE_EN_ROUTE
+			|| packet.speed != knots(speed) * 100 || (knots(speed) > 0 && packet.course != course)) {
+			fail("Mic-E", i, lat, lon, info, len);
+		}
+		if (labs(packet.lat - lat) > worst[2]) worst[2] = labs(packet.lat - lat);
+	}
+	printf("%i positions, worst latitude error %li / %li / %li micro-degrees, %lu failures\n", POSITIONS, worst[0], worst[1], worst[2], failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,128 @@
+// Test: 300 KISS clients on a unix socket, half of them never reading.
+//
+//	ctest --test-dir build -R mux_test
+//
+// Every client that reads must get every broadcast frame, intact and in
+// order, however many stalled clients are holding buffers; a stalled one
+// just misses frames. The buffer pool must never run dry, and must be whole
+// again once everyone has gone.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../mux.h"
+
+#define CLIENTS 300
+#define FRAMES 2000
+
+static unsigned long failures = 0;
+
+static void fail(const char* message, int client, int frame) {
+	if (failures++ < 10) fprintf(stderr, "client %i, frame %i: %s\n", client, frame, message);
+}
+
+static int build(unsigned char* frame, int n) {	// frame n, with bytes KISS has to escape and a length that varies
+	ax25_header header;
+	ax25_build_header(header, "N0CALL", n % 16, "APRS", 0, std::vector<std::string>{"WIDE1"}, std::vector<char>{1});
+	memcpy(frame, header.data, header.len);
+	int len = header.len;
+	len += sprintf((char*)frame + len, "!frame %i ", n);
+	for (int i=0;i<n%200;i++) frame[len++] = i % 3 == 0 ? KISS_FEND : i % 3 == 1 ? KISS_FESC : 'a' + i % 26;
+	return len;
+}
+
+int main() {
+	char path[64];
+	sprintf(path, "/tmp/mux_test.%i.sock", (int)getpid());
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	int listener = mux_listen_unix(path);
+	if (epfd == -1 || listener == -1) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	kiss_mux mux;
+	mux_init(mux, epfd, 1, CLIENTS);
+	int pool = mux.free_buffer_count;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	int fds[CLIENTS];
+	int clients[CLIENTS];
+	for (int i=0;i<CLIENTS;i++) {
+		fds[i] = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fds[i] == -1 || connect(fds[i], (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+			fprintf(stderr, "client %i: %s\n", i, strerror(errno));
+			return EXIT_FAILURE;
+		}
+		clients[i] = mux_accept(mux, listener);
+		if (clients[i] == -1) {
+			fprintf(stderr, "client %i not accepted\n", i);
+			return EXIT_FAILURE;
+		}
+		int small = 4096;						// so the stalled ones back up after a few frames
+		if (i % 2) setsockopt(mux.clients[clients[i]].fd, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+	}
+
+	static kiss_deframer rx[CLIENTS];			// odd clients never read
+	int next[CLIENTS] = {0};					// frame each reader expects next
+	for (int i=0;i<CLIENTS;i+=2) kiss_deframer_init(rx[i]);
+	for (int n=0;n<FRAMES;n++) {
+		unsigned char frame[AX25_MAX_HEADER + AX25_MAX_INFO];
+		int len = build(frame, n);
+		if (mux.free_buffer_count == 0) fail("buffer pool ran dry", -1, n);
+		mux_broadcast(mux, n % MUX_MAX_PORTS, frame, len);
+
+		struct epoll_event events[64];			// what the event loop would do
+		int count;
+		while ((count = epoll_wait(epfd, events, 64, 0)) > 0) {
+			bool flushed = false;
+			for (int e=0;e<count;e++) {
+				int client = EVENT_INDEX(events[e].data.u64);
+				if ((events[e].events & EPOLLOUT) && mux.clients[client].len > 0) {
+					mux_flush(mux, client);
+					flushed = true;
+				}
+			}
+			if (!flushed) break;				// stalled clients stay writable-pending, nothing more to do
+		}
+
+		for (int i=0;i<CLIENTS;i+=2) {
+			while (kiss_read(rx[i], fds[i]) > 0) {
+				unsigned char* got;
+				int got_len;
+				while (kiss_next(rx[i], got, got_len)) {
+					unsigned char want[AX25_MAX_HEADER + AX25_MAX_INFO];
+					int want_len = build(want, next[i]);
+					if (got[0] != (next[i] % MUX_MAX_PORTS) << 4 || got_len - 1 != want_len || memcmp(got + 1, want, want_len) != 0) {
+						fail("frame came back wrong or out of order", i, next[i]);
+					}
+					next[i]++;
+				}
+			}
+		}
+	}
+
+	unsigned long missed = 0;
+	for (int i=0;i<CLIENTS;i++) {
+		if (i % 2 == 0 && next[i] != FRAMES) fail("reader didn't get every frame", i, next[i]);
+		if (i % 2 == 1) missed += mux.clients[clients[i]].dropped;
+	}
+	if (missed == 0) fail("stalled clients never missed a frame, the test didn't stall them", -1, FRAMES);
+	if (mux.dropped != 0) fail("frames dropped as too big", -1, FRAMES);
+	for (int i=0;i<CLIENTS;i++) {
+		mux_close(mux, clients[i]);
+		close(fds[i]);
+	}
+	if (mux.free_buffer_count != pool) fail("buffers not back in the pool", -1, FRAMES);
+	unlink(path);
+
+	printf("%i clients, %i frames, %lu missed by stalled clients, %lu failures\n", CLIENTS, FRAMES, missed, failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,127 @@
+// Test: the station table's grid queries against a brute force scan of 50000 stations.
+//
+//	ctest --test-dir build -R stations_test
+//
+// station_within() and station_nearest_digi() only visit the grid cells a
+// circle overlaps. 2000 random queries, some across the dateline and near
+// the poles, must find exactly what checking every station finds. Also
+// checks that a used up WIDEn-N in a path isn't taken for a digipeater.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "../stations.h"
+
+#define STATIONS 50000
+#define QUERIES 2000
+
+static unsigned long failures = 0;
+
+static float brute_d2(const station_db& db, int i, long lat, long lon) {	// the same flat earth sum scan() does, in degrees squared
+	float scale = cosf(lat / 1e6f * (float)M_PI / 180);
+	float dlat = (db.lat[i] - lat) / 1e6f;
+	long dlon_u = db.lon[i] - lon;
+	if (dlon_u > 180000000L) dlon_u -= 360000000L;
+	else if (dlon_u < -180000000L) dlon_u += 360000000L;
+	float dlon = dlon_u / 1e6f * scale;
+	return dlat * dlat + dlon * dlon;
+}
+
+static long random_lat() {
+	if (rand() % 10 == 0) return (rand() % 2 ? 1 : -1) * (89000000L + rand() % 999999);	// near a pole
+	if (rand() % 2) return 40000000L + rand() % 4000000;	// a busy area
+	return (long)(rand() % 179999999) - 89999999;
+}
+
+static long random_lon() {
+	if (rand() % 10 == 0) return (rand() % 2 ? 1 : -1) * (178000000L + rand() % 1999999);	// by the dateline
+	if (rand() % 2) return -75000000L + rand() % 4000000;
+	return (long)(rand() % 359999999) - 179999999;
+}
+
+static void heard(station_db& db, const char* call, long lat, long lon, char symbol, const char* via1, const char* via2) {
+	unsigned char source[AX25_ADDR_LEN];
+	unsigned char via[2][AX25_ADDR_LEN];
+	ax25_address(source, call);
+	ax25_frame frame = ax25_frame();
+	frame.source = source;
+	const char* vias[2] = {via1, via2};
+	for (int d=0;d<2 && vias[d] != NULL;d++) {
+		ax25_address(via[d], vias[d]);
+		via[d][6] |= 0x80;					// H bit, repeated
+		frame.via[frame.digis++] = via[d];
+	}
+	aprs_packet packet = aprs_packet();
+	packet.has_position = true;
+	packet.lat = lat;
+	packet.lon = lon;
+	packet.table = '/';
+	packet.symbol = symbol;
+	station_heard(db, frame, &packet, 1000);
+}
+
+int main() {
+	srand(1);
+	station_db db;
+	station_init(db, STATIONS);
+	for (int i=0;i<STATIONS;i++) {
+		char call[10];
+		sprintf(call, "T%05i-%i", i / 16, i % 16);
+		heard(db, call, random_lat(), random_lon(), i % 50 == 0 ? '#' : '>', NULL, NULL);	// 2% digis
+	}
+	if (db.count != STATIONS) {
+		fprintf(stderr, "%i of %i stations in the table\n", db.count, STATIONS);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<int> grid(STATIONS);
+	std::vector<int> brute;
+	for (int q=0;q<QUERIES;q++) {
+		long lat = random_lat();
+		long lon = random_lon();
+		int km = 1 + rand() % 500;
+		float deg = km / STATION_KM_PER_DEGREE;
+		float limit = deg * deg;
+
+		int count = station_within(db, lat, lon, km, grid.data(), STATIONS);
+		grid.resize(count);
+		brute.clear();
+		int nearest = -1;
+		float nearest_d2 = 0;
+		for (int i=0;i<db.count;i++) {
+			float d2 = brute_d2(db, i, lat, lon);
+			if (d2 <= limit) brute.push_back(i);
+			if ((db.flags[i] & STATION_DIGI) && d2 <= limit && (nearest == -1 || d2 < nearest_d2)) {
+				nearest = i;
+				nearest_d2 = d2;
+			}
+		}
+		std::sort(grid.begin(), grid.end());
+		if (grid != brute && failures++ < 10) {
+			fprintf(stderr, "within %i km of (%li, %li): grid found %i stations, brute force %i\n", km, lat, lon, (int)grid.size(), (int)brute.size());
+		}
+		grid.resize(STATIONS);
+
+		int digi = station_nearest_digi(db, lat, lon, km);
+		bool same = digi == nearest || (digi != -1 && nearest != -1 && brute_d2(db, digi, lat, lon) == nearest_d2);	// a tie may go either way
+		if (!same && failures++ < 10) {
+			fprintf(stderr, "nearest digi within %i km of (%li, %li): grid found %i, brute force %i\n", km, lat, lon, digi, nearest);
+		}
+	}
+
+	heard(db, "N0CALL", 0, 0, '>', "K1ABC-3", "WIDE1");	// K1ABC-3 repeated it, then the used up alias says nothing
+	unsigned char address[AX25_ADDR_LEN];
+	ax25_address(address, "K1ABC-3");
+	int k1abc = station_find(db, station_key(address));
+	ax25_address(address, "WIDE1");
+	if (k1abc == -1 || !(db.flags[k1abc] & STATION_DIGI) || station_find(db, station_key(address)) != -1) {
+		fprintf(stderr, "a path's real digi and its used up alias were recorded wrongly\n");
+		failures++;
+	}
+
+	printf("%i stations, %i queries, %lu failures\n", STATIONS, QUERIES, failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
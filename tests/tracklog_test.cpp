@@ -0,0 +1,104 @@
+// Test: the track log ring recovers after a flipped byte and a torn record.
+//
+//	ctest --test-dir build -R tracklog_test
+//
+// A ring that has wrapped must reopen where it left off. A byte flipped in
+// one record, or a record only half written when the power went, must cost
+// that record alone: the rest still read back, and appending resumes after
+// the newest record that checks out.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../tracklog.h"
+
+#define CAPACITY 100
+#define RECORDS 250				// wraps the ring two and a half times
+
+static unsigned long failures = 0;
+
+static void check(bool ok, const char* what) {
+	if (ok) return;
+	fprintf(stderr, "%s\n", what);
+	failures++;
+}
+
+static gps_fix fix_for(unsigned long long seq) {	// a fix we can tell apart by its sequence number
+	gps_fix fix = gps_fix();
+	fix.valid = true;
+	fix.lat = 40000000L + seq * 1000;
+	fix.lon = -75000000L - seq * 1000;
+	fix.speed = seq * 10 % 65536;
+	fix.hdg = seq % 360;
+	time_t t = 1700000000 + seq;
+	gmtime_r(&t, &fix.time);
+	return fix;
+}
+
+static bool intact(const tracklog& log, unsigned long long seq) {
+	tracklog_record record;
+	gps_fix fix = fix_for(seq);
+	return tracklog_get(log, seq, record) && record.lat == fix.lat && record.lon == fix.lon && record.course == fix.hdg;
+}
+
+static bool open_log(tracklog& log, const char* path) {
+	if (tracklog_open(log, path, CAPACITY, true)) return true;
+	fprintf(stderr, "%s: %s\n", path, strerror(errno));
+	return false;
+}
+
+static long long offset(unsigned long long seq) {	// where a record lies in the file
+	return TRACKLOG_HEADER_SIZE + (long long)(seq % CAPACITY) * sizeof(tracklog_record);
+}
+
+int main() {
+	char path[64];
+	sprintf(path, "/tmp/tracklog_test.%i.ring", (int)getpid());
+	unlink(path);
+	tracklog log;
+
+	if (!open_log(log, path)) return EXIT_FAILURE;
+	for (unsigned long long seq=1;seq<=RECORDS;seq++) tracklog_append(log, TRACK_FIX, fix_for(seq), 0);
+	tracklog_close(log);
+
+	if (!open_log(log, path)) return EXIT_FAILURE;		// a clean restart
+	check(log.recovered == CAPACITY && log.torn == 0, "clean reopen didn't recover every record");
+	check(log.first_seq == RECORDS - CAPACITY + 1 && log.next_seq.load() == RECORDS + 1, "clean reopen didn't resume after the newest record");
+	for (unsigned long long seq=RECORDS-CAPACITY+1;seq<=RECORDS;seq++) check(intact(log, seq), "record lost on a clean reopen");
+	tracklog_close(log);
+
+	int fd = open(path, O_RDWR);						// flip a byte in the middle of one record
+	unsigned char byte;
+	pread(fd, &byte, 1, offset(200) + 12);
+	byte ^= 0x10;
+	pwrite(fd, &byte, 1, offset(200) + 12);
+	close(fd);
+	if (!open_log(log, path)) return EXIT_FAILURE;
+	check(log.recovered == CAPACITY - 1 && log.torn == 1, "flipped byte not caught as one bad record");
+	check(!intact(log, 200), "record with a flipped byte still read back");
+	for (unsigned long long seq=RECORDS-CAPACITY+1;seq<=RECORDS;seq++) check(seq == 200 || intact(log, seq), "a flipped byte cost more than its own record");
+	check(log.next_seq.load() == RECORDS + 1, "flipped byte moved where appending resumes");
+
+	tracklog_record old;								// power goes halfway through the next append
+	memcpy(&old, &log.records[(RECORDS + 1) % CAPACITY], sizeof(old));
+	tracklog_append(log, TRACK_BEACON, fix_for(RECORDS + 1), 1);
+	tracklog_close(log);
+	fd = open(path, O_RDWR);
+	pwrite(fd, (unsigned char*)&old + 16, 16, offset(RECORDS + 1) + 16);	// the new first half, the old second half
+	close(fd);
+	if (!open_log(log, path)) return EXIT_FAILURE;
+	check(log.torn == 2 && log.recovered == CAPACITY - 2, "torn record not caught");
+	check(!intact(log, RECORDS + 1) && !intact(log, RECORDS + 1 - CAPACITY), "torn record read back as either of its halves");
+	check(log.next_seq.load() == RECORDS + 1, "appending doesn't resume after the newest good record");
+	for (unsigned long long seq=RECORDS-CAPACITY+2;seq<=RECORDS;seq++) check(seq == 200 || intact(log, seq), "a torn record cost more than its own slot");
+	tracklog_append(log, TRACK_FIX, fix_for(RECORDS + 1), 0);	// and the slot is good again once rewritten
+	check(intact(log, RECORDS + 1), "rewritten slot doesn't read back");
+	tracklog_close(log);
+	unlink(path);
+
+	printf("%i records in a ring of %i, %lu failures\n", RECORDS, CAPACITY, failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
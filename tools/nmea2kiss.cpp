@@ -0,0 +1,380 @@
+// Replay NMEA logs offline through the tracker's beaconing, in parallel.
+//
+//	cmake --build build --target nmea2kiss
+//	./build/nmea2kiss [-c aprstoolkit.ini] [-o frames/] [-j jobs] logs/*.nmea > airtime.csv
+//
+// Each log is one unit with its own SmartBeaconing, dupe filter and channel
+// load, run the way main() runs them, on the log's own RMC clock instead of
+// the wall clock: a fix is a pass of the event loop, and the beacon timer
+// going off between two fixes is a pass at that time with the older one.
+// Beacons are encoded by send_pos_report()'s own beacon_encode(). Logs are mapped and
+// walked in place, one thread per core, so days of fixes go by in seconds.
+//
+//	-c file		the tracker's config: callsign, path, beacon format and
+//				SmartBeaconing, [tnc] radio_baud, [channel] and [dupe]
+//	-o dir		write the KISS frames each unit would have sent to
+//				dir/<log name>.kiss, ready for a TNC or a decoder
+//	-j jobs		threads, one per core by default
+//	-g seconds	a gap in the fixes longer than this is the unit switched
+//				off: no beacons during it, a startup beacon after it (600)
+//	-u			take each unit's callsign from its log's name up to the
+//				first '.' ("N0CALL-9.nmea"), if it is one
+//
+// One CSV line per log goes to stdout, in the order given, with what went
+// on the air: frames by why SmartBeaconing sent them, beacons the dupe
+// filter dropped, AX.25 bytes and airtime, also as a percentage of the time
+// the unit was on. Only RMC sentences are looked at, like gps_thread().
+// Not modelled: the airtime budget of the TX queue (it only ever delays a
+// beacon), warm starts, objects and anything heard on the channel.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../INIReader.h"
+#include "../aprs.h"
+#include "../ax25.h"
+#include "../beacon.h"
+#include "../channel.h"
+#include "../dupe.h"
+#include "../nmea.h"
+#include "../smartbeacon.h"
+
+using namespace std;
+
+struct batch_config {			// what every unit shares, from the config and the command line
+	string mycall;
+	int myssid;
+	beacon_config beacon;		// all but the header, each unit has its own callsign
+	smartbeacon sb;				// settings only, each unit gets a copy
+	int radio_baud;
+	int channel_window, channel_target, channel_min_scale, channel_max_scale;
+	int dupe_window;
+	int gap;					// seconds
+	const char* out_dir;
+	bool names;
+};
+
+struct unit {					// one log and what replaying it sent
+	const char* path;
+	char call[10];
+	bool failed;
+	unsigned long long size;	// bytes of log
+	unsigned long sentences;	// RMC sentences
+	unsigned long rejected;		// RMC sentences that were garbled or failed the checksum
+	unsigned long fixes;		// valid ones
+	unsigned long gaps;			// times the unit was off for longer than -g
+	unsigned long frames[3];	// by sb_reason
+	unsigned long dupes;		// beacons the dupe filter dropped
+	unsigned long long bytes;	// AX.25 bytes sent
+	long long airtime;			// ms
+	long long on;				// ms between fixes, gaps left out
+};
+
+struct replay {					// a tracker's beacon state, as main() keeps it in its globals
+	unit* u;
+	smartbeacon sb;
+	channel_load channel;
+	dupe_filter dupes;
+	beacon_config beacon;		// config.beacon with the unit's header
+	FILE* out;
+	bool valid;					// the fix we'd beacon
+	long lat, lon;
+	int speed, hdg;
+	long long now;				// ms on the log's clock, -1 before the first fix
+	long long due;				// what the beacon timer is armed for, if it is after 'now'
+	int date;					// day/mon/year of 'midnight', packed
+	long long midnight;			// ms
+};
+
+static batch_config config;
+static vector<unit> units;
+static atomic<int> next_unit(0);
+
+static long long monotonic_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long days_from_civil(int y, int m, int d) {	// days since 1970-01-01, proleptic Gregorian
+	y -= m <= 2;
+	long long era = (y >= 0 ? y : y - 399) / 400;
+	int yoe = y - era * 400;
+	int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static bool split_call(const string& text, string& call, int& ssid) {	// "CALL-SSID", false if it isn't a callsign
+	unsigned char address[AX25_ADDR_LEN];
+	if (!ax25_address(address, text.c_str())) return false;
+	int dash = text.find('-');
+	call = text.substr(0, dash);
+	ssid = dash == -1 ? 0 : atoi(text.c_str() + dash + 1);
+	return ssid <= 15;
+}
+
+static void settings(const char* path) {	// the same keys and defaults as the tracker
+	INIReader readconfig(path != NULL ? path : "");
+	if (path != NULL && readconfig.ParseError() != 0) {
+		fprintf(stderr, "Could not read %s\n", path);
+		exit (EXIT_FAILURE);
+	}
+	if (!split_call(readconfig.Get("station", "mycall", "N0CALL"), config.mycall, config.myssid)) {
+		fprintf(stderr, "MYCALL: Not a valid callsign.\n");
+		exit (EXIT_FAILURE);
+	}
+	if (!beacon_load(readconfig, config.beacon, config.sb)) exit (EXIT_FAILURE);	// beacon_load already said what was wrong
+
+	config.radio_baud = readconfig.GetInteger("tnc", "radio_baud", 1200);
+	config.channel_window = readconfig.GetInteger("channel", "window", 300);
+	config.channel_target = readconfig.GetInteger("channel", "target", 30);
+	config.channel_min_scale = readconfig.GetInteger("channel", "min_scale", 100);
+	config.channel_max_scale = readconfig.GetInteger("channel", "max_scale", 400);
+	config.dupe_window = readconfig.GetInteger("dupe", "window", DUPE_WINDOW);
+	if (config.radio_baud <= 0 || config.channel_window <= 0 || config.channel_target <= 0 || config.channel_min_scale <= 0 || config.channel_max_scale < config.channel_min_scale || config.dupe_window <= 0) {
+		fprintf(stderr, "radio_baud, the channel window, target, min_scale and the dupe window must be positive, and max_scale at least min_scale.\n");
+		exit (EXIT_FAILURE);
+	}
+}
+
+static void beacon(replay& r) {		// send_pos_report(), into the unit's frame file
+	gps_fix fix = gps_fix();
+	fix.lat = r.lat;
+	fix.lon = r.lon;
+	fix.speed = r.speed;
+	fix.hdg = r.hdg;
+	char pos[AX25_MAX_INFO];
+	ax25_header mice;
+	const ax25_header* header;
+	int len = beacon_encode(r.beacon, fix, pos, mice, header);
+
+	if (dupe_check(r.dupes, dupe_key(header->data, header->data + AX25_ADDR_LEN, (const unsigned char*)pos, len), r.now)) {
+		r.u->dupes++;
+		return;
+	}
+	int airtime = ax25_airtime_ms(header->len + len, config.radio_baud);
+	channel_add(r.channel, airtime, r.now);		// our own frames load the channel too
+	r.u->frames[r.sb.reason]++;
+	r.u->bytes += header->len + len;
+	r.u->airtime += airtime;
+	if (r.out != NULL) {
+		unsigned char frame[KISS_MAX_FRAME];
+		fwrite(frame, 1, kiss_encode(frame, sizeof(frame), *header, pos, len), r.out);
+	}
+}
+
+static long long pass(replay& r, long long now) {	// one go round main()'s event loop at 'now', returns when the beacon is due
+	r.now = now;
+	r.sb.scale = channel_scale(r.channel, now);
+	long long due = sb_update(r.sb, r.speed / 100.0f, r.hdg, now);
+	if (due <= now && r.valid) {
+		beacon(r);
+		sb_beacon_sent(r.sb, r.hdg, now);
+		due = sb_update(r.sb, r.speed / 100.0f, r.hdg, now);
+	}
+	return due;
+}
+
+static void fix(replay& r, const nmea_sentence& sentence, const nmea_rmc& rmc) {	// gps_thread() publishing a valid fix
+	int date = (rmc.year * 100 + rmc.mon) * 100 + rmc.day;
+	if (date != r.date) {					// timegm() for every fix would cost more than the rest of the parse
+		r.date = date;
+		r.midnight = days_from_civil(2000 + rmc.year, rmc.mon, rmc.day) * 86400000LL;
+	}
+	long long t = r.midnight + ((rmc.hour * 60 + rmc.min) * 60 + rmc.sec) * 1000LL;
+	const nmea_field& time = sentence.fields[1];	// "hhmmss.ss"
+	for (int i=7, digit=100;i<time.len&&time.ptr[6]=='.'&&digit>0;i++, digit/=10) t += (time.ptr[i] - '0') * digit;
+
+	if (r.now >= 0 && t - r.now > config.gap * 1000LL) {	// switched off: nothing went out, and it starts over
+		r.u->gaps++;
+		sb_reset(r.sb);
+	} else if (r.now >= 0) {
+		for (long long wake=r.due;wake>r.now&&wake<=t;) wake = pass(r, wake);	// the beacon timer, with the fix we had
+		if (t > r.now) r.u->on += t - r.now;
+	}
+	if (t < r.now) t = r.now;				// the loop's clock never goes backwards
+	r.valid = true;
+	r.lat = rmc.lat;
+	r.lon = rmc.lon;
+	r.speed = rmc.speed;
+	r.hdg = rmc.course / 100;
+	r.due = pass(r, t);
+	r.u->fixes++;
+}
+
+static void convert(unit& u) {
+	u.failed = true;
+	int fd = open(u.path, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		fprintf(stderr, "%s: %s\n", u.path, strerror(errno));
+		if (fd != -1) close(fd);
+		return;
+	}
+	u.size = st.st_size;
+	const char* data = NULL;
+	if (st.st_size > 0) {
+		void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) {
+			fprintf(stderr, "%s: %s\n", u.path, strerror(errno));
+			return;
+		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);	// read once, front to back
+		data = (const char*)map;
+	} else {
+		close(fd);
+	}
+
+	const char* slash = strrchr(u.path, '/');
+	string base = slash != NULL ? slash + 1 : u.path;
+	string call = config.mycall;
+	int ssid = config.myssid;
+	if (config.names && !split_call(base.substr(0, base.find('.')), call, ssid)) {
+		call = config.mycall;
+		ssid = config.myssid;
+	}
+	snprintf(u.call, sizeof(u.call), ssid != 0 ? "%s-%i" : "%s", call.c_str(), ssid);
+
+	replay r;
+	r.u = &u;
+	r.sb = config.sb;
+	channel_init(r.channel, config.channel_window, 0);
+	r.channel.target = config.channel_target;
+	r.channel.min_scale = config.channel_min_scale;
+	r.channel.max_scale = config.channel_max_scale;
+	dupe_init(r.dupes, 64, config.dupe_window);		// a unit sends a handful of beacons a window at most
+	r.beacon = config.beacon;
+	beacon_header(r.beacon, call.c_str(), ssid);
+	r.out = NULL;
+	r.valid = false;
+	r.lat = r.lon = 0;
+	r.speed = r.hdg = 0;
+	r.now = -1;
+	r.due = -1;
+	r.date = -1;
+	r.midnight = 0;
+
+	bool ok = true;
+	if (config.out_dir != NULL) {
+		string out_path = string(config.out_dir) + "/" + base + ".kiss";
+		r.out = fopen(out_path.c_str(), "w");
+		if (r.out == NULL) {
+			fprintf(stderr, "%s: %s\n", out_path.c_str(), strerror(errno));
+			ok = false;
+		}
+	}
+
+	const char* end = data + st.st_size;
+	for (const char* line=data;ok&&line<end;) {
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		if (eol == NULL) eol = end;
+		int len = eol - line;
+		if (len > 0 && line[len - 1] == '\r') len--;
+		if (len > 6 && line[0] == '$' && memcmp(line + 3, "RMC", 3) == 0) {	// skip the rest before paying for a checksum
+			u.sentences++;
+			nmea_sentence sentence;
+			nmea_rmc rmc;
+			if (!nmea_parse(line, len, sentence) || !nmea_parse_rmc(sentence, rmc)) u.rejected++;
+			else if (rmc.valid) fix(r, sentence, rmc);
+			else r.valid = false;			// no beacons until the receiver has a fix again
+		}
+		line = eol + 1;
+	}
+
+	if (r.out != NULL && fclose(r.out) != 0) {
+		fprintf(stderr, "%s: %s\n", u.path, strerror(errno));
+		ok = false;
+	}
+	if (data != NULL) munmap((void*)data, st.st_size);
+	delete[] r.channel.buckets;
+	delete[] r.dupes.keys;
+	delete[] r.dupes.ring_keys;
+	delete[] r.dupes.ring_times;
+	u.failed = !ok;
+}
+
+static void* worker(void*) {		// take logs off the list until there are none left
+	for (int i=next_unit++;i<(int)units.size();i=next_unit++) convert(units[i]);
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	const char* config_file = NULL;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	config.gap = 600;
+	config.out_dir = NULL;
+	config.names = false;
+	int c;
+	while ((c = getopt(argc, argv, "c:o:j:g:u")) != -1) {
+		switch (c) {
+		case 'c': config_file = optarg; break;
+		case 'o': config.out_dir = optarg; break;
+		case 'j': jobs = atoi(optarg); break;
+		case 'g': config.gap = atoi(optarg); break;
+		case 'u': config.names = true; break;
+		default:
+			fprintf(stderr, "Usage: nmea2kiss [-c config] [-o dir] [-j jobs] [-g seconds] [-u] nmea.log ...\n");
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind == argc || jobs <= 0 || config.gap <= 0) {
+		fprintf(stderr, "Usage: nmea2kiss [-c config] [-o dir] [-j jobs] [-g seconds] [-u] nmea.log ...\n");
+		return EXIT_FAILURE;
+	}
+	settings(config_file);
+	if (config.out_dir != NULL && mkdir(config.out_dir, 0777) == -1 && errno != EEXIST) {
+		fprintf(stderr, "%s: %s\n", config.out_dir, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	units.resize(argc - optind);
+	for (size_t i=0;i<units.size();i++) {
+		memset(&units[i], 0, sizeof(unit));
+		units[i].path = argv[optind + i];
+	}
+	if (jobs > (long)units.size()) jobs = units.size();
+
+	long long start = monotonic_ns();
+	vector<pthread_t> threads(jobs);
+	for (long i=0;i<jobs;i++) {
+		if (pthread_create(&threads[i], NULL, &worker, NULL) != 0) {
+			fprintf(stderr, "Could not start a thread: %s\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+	for (long i=0;i<jobs;i++) pthread_join(threads[i], NULL);
+	double elapsed = (monotonic_ns() - start) / 1e9;
+
+	printf("log,call,sentences,rejected,fixes,hours_on,gaps,frames,startup,rate,turn,dupes,bytes,airtime_s,airtime_percent\n");
+	unsigned long long size = 0;
+	unsigned long fixes = 0, frames = 0, failed = 0;
+	long long airtime = 0;
+	for (const unit& u : units) {
+		if (u.failed) {
+			failed++;
+			continue;
+		}
+		unsigned long sent = u.frames[SB_STARTUP] + u.frames[SB_RATE] + u.frames[SB_TURN];
+		printf("%s,%s,%lu,%lu,%lu,%.3f,%lu,%lu,%lu,%lu,%lu,%lu,%llu,%.3f,%.4f\n", u.path, u.call, u.sentences, u.rejected, u.fixes, u.on / 3.6e6, u.gaps,
+				sent, u.frames[SB_STARTUP], u.frames[SB_RATE], u.frames[SB_TURN], u.dupes, u.bytes, u.airtime / 1e3, u.on > 0 ? 100.0 * u.airtime / u.on : 0);
+		size += u.size;
+		fixes += u.fixes;
+		frames += sent;
+		airtime += u.airtime;
+	}
+	fprintf(stderr, "%zu logs (%lu failed), %.1f MB, %lu fixes in %.2f s on %li threads (%.0f MB/s): %lu frames, %.1f s of airtime\n",
+			units.size(), failed, size / 1e6, fixes, elapsed, jobs, size / 1e6 / elapsed, frames, airtime / 1e3);
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
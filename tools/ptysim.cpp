@@ -0,0 +1,471 @@
+// GPS and TNC simulator on pseudo-terminals, for testing the tracker without hardware.
+//
+//	cmake --build build --target ptysim
+//	./build/ptysim [options] [-- ./build/aprstoolkit -c sim.ini]
+//
+// Makes a pty for the GPS and one for the TNC, replays NMEA into the first
+// and acts as a KISS TNC on the second, timestamping every frame the tracker
+// sends. Point [gps] port and [tnc] port in the tracker's config at the
+// links made with -g and -t (or the pty names printed on startup). A command
+// after "--" is started once the ptys are ready and stopped with SIGTERM at
+// the end, so one invocation is a whole soak run, for CI.
+//
+//	-c file		the tracker's config, for its SmartBeaconing settings
+//	-f file		NMEA to replay, timed by its RMC sentences; synthetic if none
+//	-x scale	time scale, 1 (real time) to 1000
+//	-r rate		synthetic fixes per second, before scaling (1)
+//	-d seconds	synthetic drive length, before scaling (900)
+//	-g path		symlink to the GPS pty
+//	-t path		symlink to the TNC pty
+//	-w ms		wait before the first sentence, for the tracker to start (1000)
+//	-T ms		keep listening after the last one (2000)
+//	-M file		the tracker's [metrics] file, read at the end for sentences parsed
+//
+// Reported:
+// - fix to frame latency: from writing a fix to the GPS pty to a beacon with
+//   that position coming out of the TNC pty, as percentiles
+// - sentences dropped because the GPS pty was full (the tracker fell behind),
+//   and if -M is given, the ones that got there but weren't parsed
+// - beacon timing against a copy of the tracker's SmartBeaconing fed the
+//   same fixes on the same clock: how late each beacon was, by reason
+//
+// SmartBeaconing runs on the tracker's wall clock, so at -x 100 a drive
+// goes by 100 times faster but beacon rates are still in real seconds; that
+// is what lets a soak run push the GPS rate without changing beacon timing.
+// Channel load scaling isn't copied, the tracker's own frames alone don't
+// get near the default target.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../INIReader.h"
+#include "../aprs.h"
+#include "../ax25.h"
+#include "../beacon.h"
+#include "../kiss.h"
+#include "../nmea.h"
+#include "../smartbeacon.h"
+
+using namespace std;
+
+struct sim_sentence {			// a line of NMEA and when it goes out, in ms of simulated time
+	long long at;
+	string text;				// with "\r\n"
+	bool fix;					// a valid RMC, see sim_fix
+	long lat, lon;				// micro-degrees
+	int speed;					// hundredths of a knot
+	int course;					// degrees
+};
+
+struct sim_fix {				// a fix as it was written to the GPS pty
+	long long sent;				// monotonic ns
+	long lat, lon;
+	int speed;
+	int course;
+};
+
+struct sim_leg {				// a piece of the synthetic drive
+	int seconds;
+	double knots;
+	double turn;				// degrees per second, positive to the right
+};
+
+static const sim_leg DRIVE[] = {
+	{60, 0, 0},					// parked
+	{40, 12, 0},				// pulling out
+	{10, 12, 9},				// right at the corner
+	{120, 35, 0},
+	{6, 20, -15},				// left at the lights
+	{200, 65, 0},				// highway
+	{30, 45, 3},				// long bend on the ramp
+	{90, 40, 0},
+	{12, 10, 15},				// U-turn
+	{90, 25, 0},
+	{30, 25, 4},				// winding road
+	{30, 25, -4}
+};
+
+static long long monotonic_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static string checksummed(const char* body) {		// "$body*hh\r\n"
+	unsigned char sum = 0;
+	for (const char* p = body; *p; p++) sum ^= *p;
+	char tail[8];
+	snprintf(tail, sizeof(tail), "*%02X\r\n", sum);
+	return string("$") + body + tail;
+}
+
+static void coordinate(char* out, double degrees, int width, char positive, char negative) {	// "ddmm.mmmm,N" into 32 bytes
+	char hemisphere = degrees < 0 ? negative : positive;
+	degrees = fabs(degrees);
+	int whole = (int)degrees;
+	int minutes = lround((degrees - whole) * 600000);	// 10^-4 minutes
+	if (minutes >= 600000) {
+		whole++;
+		minutes -= 600000;
+	}
+	snprintf(out, 32, "%0*d%02d.%04d,%c", width, whole, minutes / 10000, minutes % 10000, hemisphere);
+}
+
+static void synthesize(vector<sim_sentence>& sentences, double rate, int seconds) {	// drive DRIVE around and around
+	time_t start = time(NULL);					// real dates, so fix ages and warm starts make sense
+	double lat = 48.1173, lon = 11.516667, course = 0;
+	long long step = (long long)(1000 / rate);
+	int leg = 0;
+	long long leg_end = DRIVE[0].seconds * 1000LL;
+	for (long long at = 0; at <= seconds * 1000LL; at += step) {
+		while (at >= leg_end) {
+			leg = (leg + 1) % (sizeof(DRIVE) / sizeof(DRIVE[0]));
+			leg_end += DRIVE[leg].seconds * 1000LL;
+		}
+		double dt = step / 1000.0;
+		double knots = DRIVE[leg].knots;
+		course = fmod(course + DRIVE[leg].turn * dt + 360, 360);
+		lat += knots / 3600 / 60 * cos(course * M_PI / 180) * dt;		// a knot is a minute of latitude an hour
+		lon += knots / 3600 / 60 * sin(course * M_PI / 180) * dt / cos(lat * M_PI / 180);
+
+		time_t now = start + at / 1000;
+		struct tm tm;
+		gmtime_r(&now, &tm);
+		char lat_text[32], lon_text[32], body[160];
+		coordinate(lat_text, lat, 2, 'N', 'S');
+		coordinate(lon_text, lon, 3, 'E', 'W');
+		snprintf(body, sizeof(body), "GPRMC,%02d%02d%02d.%02lld,A,%s,%s,%.1f,%.1f,%02d%02d%02d,,,A", tm.tm_hour, tm.tm_min, tm.tm_sec, at % 1000 / 10,
+				lat_text, lon_text, knots, course, tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+		sim_sentence sentence = {at, checksummed(body), false, 0, 0, 0, 0};
+		sentences.push_back(sentence);
+	}
+}
+
+static void load(const char* path, vector<sim_sentence>& sentences) {	// a log, timed by its RMC sentences
+	FILE* in = fopen(path, "r");
+	if (in == NULL) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+	char line[256];
+	long long day = 0, last = -1, at = 0;
+	while (fgets(line, sizeof(line), in) != NULL) {
+		int len = strcspn(line, "\r\n");
+		if (len == 0 || line[0] != '$') continue;
+		line[len] = 0;
+		nmea_sentence sentence;
+		nmea_rmc rmc;
+		if (nmea_parse(line, len, sentence) && nmea_parse_rmc(sentence, rmc) && rmc.valid) {	// the clock moves on
+			long long time = ((rmc.hour * 60 + rmc.min) * 60 + rmc.sec) * 1000LL;
+			const nmea_field& field = sentence.fields[1];
+			int digit = 100;
+			for (int i=7;i<field.len && field.ptr[6] == '.' && digit > 0;i++, digit /= 10) time += (field.ptr[i] - '0') * digit;	// "hhmmss.ss"
+			if (last >= 0 && time + day < last - 12 * 3600000LL) day += 24 * 3600000LL;	// past midnight
+			if (last >= 0) at += max(0LL, time + day - last);
+			last = time + day;
+		}
+		sim_sentence s = {at, string(line) + "\r\n", false, 0, 0, 0, 0};
+		sentences.push_back(s);
+	}
+	fclose(in);
+}
+
+static void mark_fixes(vector<sim_sentence>& sentences) {	// what each valid RMC says, to match beacons to
+	for (sim_sentence& s : sentences) {
+		nmea_sentence sentence;
+		nmea_rmc rmc;
+		int len = s.text.length() - 2;
+		if (!nmea_parse(s.text.c_str(), len, sentence) || !nmea_parse_rmc(sentence, rmc) || !rmc.valid) continue;
+		s.fix = true;
+		s.lat = rmc.lat;
+		s.lon = rmc.lon;
+		s.speed = rmc.speed;
+		s.course = rmc.course / 100;			// as the tracker has it
+	}
+}
+
+static int open_pty(string& name, const char* link) {	// raw both ways, the slave held open so the master never sees a hangup
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1) {
+		fprintf(stderr, "Could not make a pty: %s\n", strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+	name = ptsname(master);
+	int slave = open(name.c_str(), O_RDWR | O_NOCTTY);
+	struct termios options;
+	if (slave == -1 || tcgetattr(slave, &options) == -1) {
+		fprintf(stderr, "%s: %s\n", name.c_str(), strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+	cfmakeraw(&options);
+	tcsetattr(slave, TCSANOW, &options);
+	fcntl(master, F_SETFL, O_NONBLOCK);
+	if (link != NULL) {
+		struct stat st;
+		if (lstat(link, &st) == 0 && !S_ISLNK(st.st_mode)) {
+			fprintf(stderr, "%s exists and isn't a symlink, not replacing it\n", link);
+			exit (EXIT_FAILURE);
+		}
+		unlink(link);
+		if (symlink(name.c_str(), link) == -1) {
+			fprintf(stderr, "%s: %s\n", link, strerror(errno));
+			exit (EXIT_FAILURE);
+		}
+	}
+	return master;
+}
+
+static void settings(smartbeacon& sb, const char* path) {	// the tracker's own [beacon] loading, for the same keys and defaults
+	INIReader config(path != NULL ? path : "");
+	if (path != NULL && config.ParseError() != 0) {
+		fprintf(stderr, "Could not read %s\n", path);
+		exit (EXIT_FAILURE);
+	}
+	beacon_config beacon;					// only the SmartBeaconing settings matter here
+	if (!beacon_load(config, beacon, sb)) exit (EXIT_FAILURE);
+}
+
+static bool write_all(int fd, const string& text, bool& dropped) {	// a whole line or none of it, never half
+	int done = 0;
+	while (done < (int)text.length()) {
+		int n = write(fd, text.data() + done, text.length() - done);
+		if (n > 0) {
+			done += n;
+			continue;
+		}
+		if (n == -1 && errno != EAGAIN && errno != EINTR) return false;
+		if (done == 0) {						// the tracker isn't keeping up, this one is lost
+			dropped = true;
+			return true;
+		}
+		struct pollfd pfd = {fd, POLLOUT, 0};	// finish what was started, so the next line is clean
+		poll(&pfd, 1, 100);
+	}
+	dropped = false;
+	return true;
+}
+
+static double percentile(vector<double>& values, double p) {
+	if (values.empty()) return 0;
+	size_t i = (size_t)(p / 100 * (values.size() - 1) + 0.5);
+	nth_element(values.begin(), values.begin() + i, values.end());
+	return values[i];
+}
+
+static void report(const char* what, vector<double>& values) {
+	if (values.empty()) {
+		printf("  %-24s none\n", what);
+		return;
+	}
+	double sum = 0;
+	for (double v : values) sum += v;
+	double p50 = percentile(values, 50), p90 = percentile(values, 90), p99 = percentile(values, 99), top = percentile(values, 100);
+	printf("  %-24s n=%zu mean %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f ms\n", what, values.size(), sum / values.size(), p50, p90, p99, top);
+}
+
+static long metrics_parsed(const char* path) {	// aprs_nmea_sentences_total{result="parsed"}, or -1
+	FILE* in = fopen(path, "r");
+	if (in == NULL) return -1;
+	char line[256];
+	long parsed = -1;
+	while (fgets(line, sizeof(line), in) != NULL) {
+		sscanf(line, "aprs_nmea_sentences_total{result=\"parsed\"} %ld", &parsed);
+	}
+	fclose(in);
+	return parsed;
+}
+
+int main(int argc, char** argv) {
+	const char* config = NULL;
+	const char* nmea_file = NULL;
+	const char* gps_link = NULL;
+	const char* tnc_link = NULL;
+	const char* metrics_file = NULL;
+	double scale = 1, rate = 1;
+	int seconds = 900, settle = 1000, tail = 2000;
+	int c;
+	while ((c = getopt(argc, argv, "+c:f:x:r:d:g:t:w:T:M:")) != -1) {
+		switch (c) {
+		case 'c': config = optarg; break;
+		case 'f': nmea_file = optarg; break;
+		case 'x': scale = atof(optarg); break;
+		case 'r': rate = atof(optarg); break;
+		case 'd': seconds = atoi(optarg); break;
+		case 'g': gps_link = optarg; break;
+		case 't': tnc_link = optarg; break;
+		case 'w': settle = atoi(optarg); break;
+		case 'T': tail = atoi(optarg); break;
+		case 'M': metrics_file = optarg; break;
+		default:
+			fprintf(stderr, "Usage: ptysim [-c config] [-f nmea.log] [-x scale] [-r rate] [-d seconds] [-g gps_link] [-t tnc_link] [-w ms] [-T ms] [-M metrics] [-- command ...]\n");
+			return EXIT_FAILURE;
+		}
+	}
+	if (scale < 1 || scale > 1000 || rate <= 0 || rate > 1000 || seconds <= 0) {
+		fprintf(stderr, "Scale must be 1-1000, rate 0-1000 and seconds positive.\n");
+		return EXIT_FAILURE;
+	}
+
+	smartbeacon mirror;						// the tracker's SmartBeaconing, fed what we send
+	settings(mirror, config);
+	vector<sim_sentence> sentences;
+	if (nmea_file != NULL) load(nmea_file, sentences);
+	else synthesize(sentences, rate, seconds);
+	mark_fixes(sentences);
+	if (sentences.empty()) {
+		fprintf(stderr, "No NMEA to send\n");
+		return EXIT_FAILURE;
+	}
+
+	string gps_name, tnc_name;
+	int gps = open_pty(gps_name, gps_link);
+	int tnc = open_pty(tnc_name, tnc_link);
+	printf("GPS on %s, TNC on %s: %zu sentences over %.1f s at %gx\n", gps_name.c_str(), tnc_name.c_str(), sentences.size(), sentences.back().at / 1000.0 / scale, scale);
+	fflush(stdout);
+
+	pid_t child = -1;
+	if (optind < argc) {
+		child = fork();
+		if (child == 0) {
+			execvp(argv[optind], argv + optind);
+			fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+			_exit (127);
+		}
+	}
+
+	kiss_deframer rx;
+	kiss_deframer_init(rx);
+	vector<sim_fix> fixes;
+	vector<double> latency, lateness[3];
+	unsigned long written = 0, dropped = 0, frames = 0, positions = 0, unmatched = 0;
+	unsigned long reasons[3] = {0};
+	long long predicted = -1;				// when the mirror says the next beacon is due, monotonic ms
+	int due_reason = SB_STARTUP;
+	int due_fix = -1;						// the fix it goes out with, once it is due
+
+	long long start = monotonic_ns() + settle * 1000000LL;
+	long long end = start + (long long)(sentences.back().at * 1e6 / scale) + tail * 1000000LL;
+	size_t next = 0;
+	while (true) {
+		long long now = monotonic_ns();
+		while (next < sentences.size() && start + (long long)(sentences[next].at * 1e6 / scale) <= now) {
+			const sim_sentence& s = sentences[next++];
+			bool lost;
+			if (!write_all(gps, s.text, lost)) {
+				fprintf(stderr, "GPS pty write failed: %s\n", strerror(errno));
+				return EXIT_FAILURE;
+			}
+			if (lost) {
+				dropped++;
+				continue;
+			}
+			written++;
+			if (!s.fix) continue;
+			long long sent = monotonic_ns();
+			sim_fix fix = {sent, s.lat, s.lon, s.speed, s.course};
+			if (due_fix == -1 && predicted >= 0 && predicted <= sent / 1000000) due_fix = fixes.size() - 1;	// the timer went off before this fix
+			fixes.push_back(fix);
+			if (due_fix != -1) continue;		// due already, a later fix doesn't make it any less late
+			long long due = sb_update(mirror, fix.speed / 100.0f, fix.course, sent / 1000000);
+			predicted = max(due, sent / 1000000);
+			due_reason = mirror.reason;
+			if (due <= sent / 1000000) due_fix = fixes.size() - 1;
+		}
+		if (next == sentences.size() && now >= end) break;
+
+		long long wake = next < sentences.size() ? start + (long long)(sentences[next].at * 1e6 / scale) : end;
+		struct pollfd pfd = {tnc, POLLIN, 0};
+		struct timespec timeout = {0, 0};
+		if (wake > now) {
+			timeout.tv_sec = (wake - now) / 1000000000;
+			timeout.tv_nsec = (wake - now) % 1000000000;
+		}
+		if (ppoll(&pfd, 1, &timeout, NULL) <= 0 || kiss_read(rx, tnc) <= 0) continue;
+		long long arrived = monotonic_ns();		// for everything in this read
+
+		unsigned char* data;
+		int len;
+		while (kiss_next(rx, data, len)) {
+			if ((data[0] & 0x0F) != 0) continue;	// not a data frame
+			frames++;
+			ax25_frame frame;
+			if (!ax25_parse(data + 1, len - 1, frame)) continue;
+			char destination[10];
+			int destination_len = ax25_address_text(destination, frame.destination);
+			aprs_packet packet;
+			if (!aprs_decode(destination, destination_len, (const char*)frame.info, frame.info_len, packet) || packet.type != APRS_POSITION) continue;
+			positions++;
+			if (due_fix == -1 && !fixes.empty()) {	// not due yet by the mirror; the tracker may have crossed turn_time a fix sooner
+				const sim_fix& last = fixes.back();
+				long long due = sb_update(mirror, last.speed / 100.0f, last.course, arrived / 1000000);
+				if (due <= arrived / 1000000) {
+					due_reason = mirror.reason;
+					long long turn_ok = mirror.last_beacon + mirror.turn_time * 1000LL + 1;
+					predicted = max(last.sent / 1000000, due_reason == SB_TURN ? turn_ok : due);
+					due_fix = fixes.size() - 1;
+				}
+			}
+
+			// Which fix this is. Usually the one the mirror says it should be;
+			// matching on position alone would pick one sent after the beacon
+			// was made whenever several fixes encode the same.
+			long tolerance = packet.format == APRS_COMPRESSED ? 10 : 170;	// the encoding's resolution, micro-degrees
+			int i = due_fix;
+			if (i < 0 || labs(fixes[i].lat - packet.lat) > tolerance || labs(fixes[i].lon - packet.lon) > tolerance) {
+				for (i = fixes.size() - 1; i >= 0; i--) {	// the newest fix it could be
+					if (labs(fixes[i].lat - packet.lat) <= tolerance && labs(fixes[i].lon - packet.lon) <= tolerance) break;
+				}
+			}
+			if (i >= 0) latency.push_back((arrived - fixes[i].sent) / 1e6);
+			else unmatched++;
+			if (predicted >= 0) {
+				lateness[due_reason].push_back(arrived / 1e6 - predicted);
+				reasons[due_reason]++;
+			}
+
+			sb_beacon_sent(mirror, i >= 0 ? fixes[i].course : 0, arrived / 1000000);	// in step with the tracker again
+			due_fix = -1;
+			if (!fixes.empty()) {
+				predicted = sb_update(mirror, fixes.back().speed / 100.0f, fixes.back().course, arrived / 1000000);
+				due_reason = mirror.reason;
+			}
+		}
+	}
+
+	if (child > 0) {
+		kill(child, SIGTERM);
+		waitpid(child, NULL, 0);
+	}
+	if (gps_link != NULL) unlink(gps_link);
+	if (tnc_link != NULL) unlink(tnc_link);
+
+	printf("\nSentences: %lu written, %lu dropped (GPS pty full)", written, dropped);
+	if (metrics_file != NULL) {
+		long parsed = metrics_parsed(metrics_file);
+		if (parsed >= 0) printf(", %ld parsed by the tracker, %ld lost", parsed, (long)written - parsed);
+		else printf(", no metrics in %s", metrics_file);
+	}
+	printf("\nFrames: %lu, %lu positions, %lu not matched to a fix\n", frames, positions, unmatched);
+	report("fix to frame", latency);
+	printf("Beacon timing, received less due by SmartBeaconing (%s):\n", mirror.static_rate != 0 ? "static rate" : "smart");
+	static const char* NAMES[3] = {"startup", "rate", "turn"};
+	for (int i=0;i<3;i++) {
+		char what[32];
+		snprintf(what, sizeof(what), "%s (%lu)", NAMES[i], reasons[i]);
+		report(what, lateness[i]);
+	}
+	return positions > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,80 @@
+// Dump a track log ring, oldest first, as CSV or GPX.
+//
+//	cmake --build build --target tracklog_dump
+//	./build/tracklog_dump [-g] track.log > track.csv
+//
+// Reads the ring the same way the tracker recovers it after a crash, so
+// whatever made it to the file before a power cut comes out, and torn
+// records are skipped. Safe to run while the tracker is appending.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <time.h>
+#include "../hdlc.h"
+#include "../tracklog.h"
+
+static const char* FORMATS[] = {"uncompressed", "compressed", "mic-e"};
+
+static void iso_time(char* out, int size, long long ms) {
+	time_t seconds = ms / 1000;
+	struct tm utc;
+	gmtime_r(&seconds, &utc);
+	strftime(out, size, "%Y-%m-%dT%H:%M:%SZ", &utc);
+}
+
+int main(int argc, char** argv) {
+	bool gpx = false;
+	int arg = 1;
+	if (arg < argc && strcmp(argv[arg], "-g") == 0) {
+		gpx = true;
+		arg++;
+	}
+	if (arg + 1 != argc) {
+		fprintf(stderr, "Usage: %s [-g] tracklog\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	tracklog log;
+	if (!tracklog_open(log, argv[arg], 0, false)) {
+		fprintf(stderr, "%s: %s\n", argv[arg], strerror(errno));
+		return EXIT_FAILURE;
+	}
+	unsigned long long last = log.next_seq.load() - 1;
+	unsigned long long first = log.first_seq;
+	if (last >= log.header->capacity && last - log.header->capacity + 1 > first) first = last - log.header->capacity + 1;
+	fprintf(stderr, "%lu records, %lu torn, sequence %llu to %llu\n", log.recovered, log.torn, first, last);
+
+	if (gpx) {
+		printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+		printf("<gpx version=\"1.1\" creator=\"APRS Toolkit\" xmlns=\"http://www.topografix.com/GPX/1/1\">\n");
+		for (unsigned long long seq=first;first!=0&&seq<=last;seq++) {		// beacons as waypoints
+			tracklog_record record;
+			if (!tracklog_get(log, seq, record) || record.type != TRACK_BEACON) continue;
+			char time[32];
+			iso_time(time, sizeof(time), record.time);
+			printf(" <wpt lat=\"%.6f\" lon=\"%.6f\"><time>%s</time><name>beacon %llu</name><desc>%s</desc></wpt>\n",
+					record.lat / 1e6, record.lon / 1e6, time, seq, record.format < 3 ? FORMATS[record.format] : "");
+		}
+		printf(" <trk><name>track</name><trkseg>\n");
+	} else {
+		printf("seq,time,type,lat,lon,knots,course,format\n");
+	}
+	for (unsigned long long seq=first;first!=0&&seq<=last;seq++) {
+		tracklog_record record;
+		if (!tracklog_get(log, seq, record)) continue;		// torn, or overwritten while we read
+		char time[32];
+		iso_time(time, sizeof(time), record.time);
+		if (gpx) {
+			if (record.type != TRACK_FIX) continue;
+			printf("  <trkpt lat=\"%.6f\" lon=\"%.6f\"><time>%s</time></trkpt>\n", record.lat / 1e6, record.lon / 1e6, time);
+		} else {
+			printf("%llu,%s,%s,%.6f,%.6f,%.2f,%u,%s\n", seq, time, record.type == TRACK_FIX ? "fix" : "beacon",
+					record.lat / 1e6, record.lon / 1e6, record.speed / 100.0, record.course,
+					record.type == TRACK_BEACON && record.format < 3 ? FORMATS[record.format] : "");
+		}
+	}
+	if (gpx) printf(" </trkseg></trk>\n</gpx>\n");
+	tracklog_close(log);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+// Debug trace: fixed size records through per-thread rings, formatted by a background thread.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+static std::atomic<trace_queue*> trace_queues[TRACE_MAX_THREADS];
+static std::atomic<int> trace_threads(0);
+static thread_local trace_queue* trace_mine = NULL;
+static thread_local bool trace_refused = false;	// no ring left for this thread
+static FILE* trace_out = stdout;
+static int trace_interval = 50;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;	// one formatter at a time
+static unsigned long trace_reported[TRACE_MAX_THREADS];		// drops already owned up to
+
+trace_queue* trace_thread_queue() {
+	if (trace_mine != NULL || trace_refused) return trace_mine;
+	int index = trace_threads.fetch_add(1);
+	if (index >= TRACE_MAX_THREADS) {
+		trace_refused = true;
+		return NULL;
+	}
+	trace_mine = new trace_queue;
+	trace_mine->head.store(0);
+	trace_mine->tail.store(0);
+	trace_mine->dropped.store(0);
+	trace_queues[index].store(trace_mine, std::memory_order_release);
+	return trace_mine;
+}	// END OF 'trace_thread_queue'
+
+static void print_spec(FILE* out, const char* spec, const int* stars, int star_count, const trace_record& record, char conv, long long i, double d) {
+	if (conv == 'd' || conv == 'i' || conv == 'u' || conv == 'o' || conv == 'x' || conv == 'X') {
+		if (star_count == 0) fprintf(out, spec, i);
+		else if (star_count == 1) fprintf(out, spec, stars[0], i);
+		else fprintf(out, spec, stars[0], stars[1], i);
+	} else if (conv == 'c') {
+		if (star_count == 0) fprintf(out, spec, (int)i);
+		else fprintf(out, spec, stars[0], (int)i);
+	} else if (conv == 's') {					// spec ends ".*s", the length is ours
+		int offset = i >> 16;
+		int len = i & 0xFFFF;
+		if (offset < 0 || offset + len > TRACE_TEXT) len = offset = 0;	// not a string argument after all
+		if (star_count == 0) fprintf(out, spec, len, record.text + offset);
+		else fprintf(out, spec, stars[0], len, record.text + offset);
+	} else {
+		if (star_count == 0) fprintf(out, spec, d);
+		else if (star_count == 1) fprintf(out, spec, stars[0], d);
+		else fprintf(out, spec, stars[0], stars[1], d);
+	}
+}
+
+static void print_record(FILE* out, const trace_record& record) {	// a printf of the format with the saved arguments
+	time_t seconds = record.time / 1000000000LL;
+	struct tm utc;
+	gmtime_r(&seconds, &utc);
+	fprintf(out, "%02i:%02i:%02i.%03i ", utc.tm_hour, utc.tm_min, utc.tm_sec, (int)(record.time / 1000000 % 1000));
+	const char* f = record.format;
+	int arg = 0;
+	while (*f) {
+		if (*f != '%') {
+			const char* next = strchr(f, '%');
+			int n = next != NULL ? next - f : strlen(f);
+			fwrite(f, 1, n, out);
+			f += n;
+			continue;
+		}
+		if (f[1] == '%') {
+			fputc('%', out);
+			f += 2;
+			continue;
+		}
+		char spec[32];
+		int len = 0;
+		int stars[2];
+		int star_count = 0;
+		bool precision_star = false;
+		spec[len++] = *f++;
+		while (*f && strchr("-+ #0", *f) && len < 8) spec[len++] = *f++;
+		if (*f == '*') {
+			stars[star_count++] = arg < record.count ? record.args[arg++].i : 0;
+			spec[len++] = *f++;
+		}
+		while (*f >= '0' && *f <= '9' && len < 16) spec[len++] = *f++;
+		int precision = len;					// where a precision would start, strings put their own there
+		if (*f == '.') {
+			spec[len++] = *f++;
+			if (*f == '*') {
+				stars[star_count++] = arg < record.count ? record.args[arg++].i : 0;
+				spec[len++] = *f++;
+				precision_star = true;
+			}
+			while (*f >= '0' && *f <= '9' && len < 24) spec[len++] = *f++;
+		}
+		while (*f && strchr("hlLqjzt", *f)) f++;	// the saved argument's size is ours to say
+		char conv = *f;
+		if (conv == 0) break;
+		f++;
+		long long i = 0;
+		double d = 0;
+		if (arg < record.count) {
+			i = record.args[arg].i;
+			d = record.args[arg].d;
+			arg++;
+		}
+		if (conv == 'T') {						// time_t, like asctime()
+			time_t t = i;
+			struct tm when;
+			char text[32];
+			gmtime_r(&t, &when);
+			fputs(asctime_r(&when, text), out);
+			continue;
+		}
+		if (conv == 's') {
+			if (precision_star) star_count--;	// the length is the saved string's
+			len = precision;
+			spec[len++] = '.';
+			spec[len++] = '*';
+		} else if (strchr("diuoxX", conv)) {
+			spec[len++] = 'l';
+			spec[len++] = 'l';
+		} else if (!strchr("cfFeEgGaA", conv)) {
+			continue;							// nothing we know how to print
+		}
+		spec[len++] = conv;
+		spec[len] = 0;
+		print_spec(out, spec, stars, star_count, record, conv, i, d);
+	}
+}
+
+static void drain() {		// write out everything queued, merged in time order
+	pthread_mutex_lock(&trace_lock);
+	int threads = std::min(trace_threads.load(), TRACE_MAX_THREADS);
+	while (true) {
+		trace_queue* oldest = NULL;
+		for (int t=0;t<threads;t++) {
+			trace_queue* queue = trace_queues[t].load(std::memory_order_acquire);
+			if (queue == NULL) continue;
+			unsigned long tail = queue->tail.load(std::memory_order_relaxed);
+			if (tail == queue->head.load(std::memory_order_acquire)) continue;
+			if (oldest == NULL || queue->records[tail & (TRACE_QUEUE - 1)].time < oldest->records[oldest->tail.load() & (TRACE_QUEUE - 1)].time) oldest = queue;
+		}
+		if (oldest == NULL) break;
+		unsigned long tail = oldest->tail.load(std::memory_order_relaxed);
+		print_record(trace_out, oldest->records[tail & (TRACE_QUEUE - 1)]);
+		oldest->tail.store(tail + 1, std::memory_order_release);	// the slot is the producer's again
+	}
+	for (int t=0;t<threads;t++) {
+		trace_queue* queue = trace_queues[t].load(std::memory_order_acquire);
+		if (queue == NULL) continue;
+		unsigned long dropped = queue->dropped.load(std::memory_order_relaxed);
+		if (dropped != trace_reported[t]) fprintf(trace_out, "TRACE: %lu records dropped, output too slow\n", dropped - trace_reported[t]);
+		trace_reported[t] = dropped;
+	}
+	fflush(trace_out);
+	pthread_mutex_unlock(&trace_lock);
+}
+
+static void* trace_thread(void*) {
+	while (true) {
+		drain();
+		usleep(trace_interval * 1000);
+	}
+	return NULL;
+}
+
+void trace_start(FILE* out, int interval_ms) {
+	trace_out = out;
+	trace_interval = interval_ms;
+	pthread_t thread;
+	pthread_create(&thread, NULL, &trace_thread, NULL);
+	pthread_detach(thread);
+}	// END OF 'trace_start'
+
+void trace_flush() {
+	drain();
+}	// END OF 'trace_flush'
@@ -0,0 +1,106 @@
+// Debug trace: fixed size records through per-thread rings, formatted by a background thread.
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <time.h>
+#include <type_traits>
+
+#define TRACE_ARGS 8			// arguments per record
+#define TRACE_TEXT 168			// bytes of string arguments per record, longer ones are cut short
+#define TRACE_QUEUE 1024		// records per thread, a power of two
+#define TRACE_MAX_THREADS 16
+
+// One trace point. The format is a printf format string literal (its
+// address doubles as the event id, it's never copied) and the arguments are
+// stored raw; nothing is formatted until the consumer thread gets to it.
+// Conversions: integers (%i, %u, %x...), %c, floating point (%f, %e, %g),
+// %s and %T for a time_t printed like asctime(). Length modifiers and "*"
+// widths work as in printf.
+struct trace_record {
+	long long time;				// CLOCK_REALTIME, ns
+	const char* format;
+	union {
+		long long i;
+		double d;
+	} args[TRACE_ARGS];
+	int count;
+	int text_len;
+	char text[TRACE_TEXT];		// string arguments, an arg is offset << 16 | length
+};
+
+// Single producer, single consumer: the owning thread only moves 'head' and
+// the consumer only moves 'tail', so neither ever waits on the other. A full
+// ring drops the record and counts it rather than block the thread that
+// is tracing.
+struct trace_queue {
+	alignas(64) std::atomic<unsigned long> head;
+	alignas(64) std::atomic<unsigned long> tail;
+	std::atomic<unsigned long> dropped;
+	trace_record records[TRACE_QUEUE];
+};
+
+struct trace_text {				// a string argument that isn't terminated, for "%s"
+	const char* ptr;
+	int len;
+};
+
+// Start the consumer thread, writing to 'out' every 'interval_ms' or so.
+void trace_start(FILE* out, int interval_ms);
+
+// Write out what is queued now, from any thread. For shutdown.
+void trace_flush();
+
+// The calling thread's ring, made on its first trace.
+trace_queue* trace_thread_queue();
+
+inline void trace_pack(trace_record&) {
+}
+
+template <typename T, typename... Rest>
+inline void trace_pack(trace_record& record, T value, Rest... rest);
+
+inline void trace_pack_text(trace_record& record, const char* ptr, int len) {
+	if (len > TRACE_TEXT - record.text_len) len = TRACE_TEXT - record.text_len;
+	memcpy(record.text + record.text_len, ptr, len);
+	record.args[record.count++].i = (long long)record.text_len << 16 | len;
+	record.text_len += len;
+}
+
+template <typename T, typename... Rest>
+inline void trace_pack(trace_record& record, T value, Rest... rest) {
+	if (record.count < TRACE_ARGS) {
+		if constexpr (std::is_same<T, trace_text>::value) trace_pack_text(record, value.ptr, value.len);
+		else if constexpr (std::is_same<T, const char*>::value || std::is_same<T, char*>::value) trace_pack_text(record, value, strlen(value));
+		else if constexpr (std::is_floating_point<T>::value) record.args[record.count++].d = value;
+		else record.args[record.count++].i = (long long)value;
+	}
+	trace_pack(record, rest...);
+}
+
+// Queue a trace record. Costs a clock read and a copy of the arguments.
+template <typename... Args>
+void trace(const char* format, Args... args) {
+	trace_queue* queue = trace_thread_queue();
+	if (queue == NULL) return;					// too many threads
+	unsigned long head = queue->head.load(std::memory_order_relaxed);
+	if (head - queue->tail.load(std::memory_order_acquire) == TRACE_QUEUE) {
+		queue->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	trace_record& record = queue->records[head & (TRACE_QUEUE - 1)];
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	record.time = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	record.format = format;
+	record.count = 0;
+	record.text_len = 0;
+	trace_pack(record, args...);
+	queue->head.store(head + 1, std::memory_order_release);
+}	// END OF 'trace'
+
+#endif  // __TRACE_H__
@@ -0,0 +1,111 @@
+// Track log: every fix and beacon in a memory mapped ring file that survives a crash.
+
+#include <cstddef>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "hdlc.h"
+#include "tracklog.h"
+
+static_assert(sizeof(tracklog_record) == 32, "records are 32 bytes on disk");
+
+static unsigned short record_crc(const tracklog_record& record) {
+	return hdlc_fcs((const unsigned char*)&record, offsetof(tracklog_record, crc));
+}
+
+static bool good(const tracklog_record& record) {
+	return record.seq != 0 && record_crc(record) == record.crc;
+}
+
+bool tracklog_open(tracklog& log, const char* path, int capacity, bool writable) {
+	log.fd = open(path, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+	if (log.fd == -1) return false;
+	tracklog_header header = {};
+	struct stat st;
+	bool fresh = fstat(log.fd, &st) == -1 || st.st_size < TRACKLOG_HEADER_SIZE ||
+			pread(log.fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != TRACKLOG_MAGIC ||
+			header.version != TRACKLOG_VERSION || header.record_size != sizeof(tracklog_record) || header.capacity == 0 ||
+			st.st_size < TRACKLOG_HEADER_SIZE + (long long)(header.capacity * sizeof(tracklog_record));
+	if (fresh) {								// new, or not one of ours: start over
+		if (!writable || capacity <= 0) {
+			close(log.fd);
+			errno = EINVAL;
+			return false;
+		}
+		header.magic = TRACKLOG_MAGIC;
+		header.version = TRACKLOG_VERSION;
+		header.record_size = sizeof(tracklog_record);
+		header.capacity = capacity;
+		long long size = TRACKLOG_HEADER_SIZE + (long long)capacity * sizeof(tracklog_record);
+		if (ftruncate(log.fd, 0) == -1 || ftruncate(log.fd, size) == -1 ||	// all zeros, every slot empty
+				pwrite(log.fd, &header, sizeof(header), 0) != sizeof(header) || fsync(log.fd) == -1) {
+			close(log.fd);
+			return false;
+		}
+	}
+
+	log.map_len = TRACKLOG_HEADER_SIZE + (long long)header.capacity * sizeof(tracklog_record);
+	void* map = mmap(NULL, log.map_len, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, log.fd, 0);
+	if (map == MAP_FAILED) {
+		close(log.fd);
+		return false;
+	}
+	log.map = (unsigned char*)map;
+	log.header = (tracklog_header*)log.map;
+	log.records = (tracklog_record*)(log.map + TRACKLOG_HEADER_SIZE);
+
+	unsigned long long last = 0;				// recover: the newest good record is where we left off
+	unsigned long long first = 0;
+	log.recovered = 0;
+	log.torn = 0;
+	for (unsigned int i=0;i<header.capacity;i++) {
+		const tracklog_record& record = log.records[i];
+		if (record.seq == 0) continue;
+		if (!good(record) || record.seq % header.capacity != i) {
+			log.torn++;
+			continue;
+		}
+		log.recovered++;
+		if (record.seq > last) last = record.seq;
+		if (first == 0 || record.seq < first) first = record.seq;
+	}
+	log.first_seq = first;
+	log.next_seq.store(last + 1);
+	return true;
+}	// END OF 'tracklog_open'
+
+void tracklog_append(tracklog& log, track_type type, const gps_fix& fix, int format) {
+	tracklog_record record;
+	memset(&record, 0, sizeof(record));
+	record.seq = log.next_seq.fetch_add(1);
+	struct tm time = fix.time;
+	record.time = timegm(&time) * 1000LL;
+	record.lat = fix.lat;
+	record.lon = fix.lon;
+	record.speed = fix.speed < 0 ? 0 : fix.speed > 65535 ? 65535 : fix.speed;
+	record.course = fix.hdg;
+	record.type = type;
+	record.format = format;
+	record.crc = record_crc(record);
+	memcpy(&log.records[record.seq % log.header->capacity], &record, sizeof(record));	// 32 byte aligned, never split across a page
+}	// END OF 'tracklog_append'
+
+bool tracklog_get(const tracklog& log, unsigned long long seq, tracklog_record& record) {
+	memcpy(&record, &log.records[seq % log.header->capacity], sizeof(record));
+	return record.seq == seq && good(record);
+}	// END OF 'tracklog_get'
+
+void tracklog_sync(tracklog& log) {
+	msync(log.map, log.map_len, MS_SYNC);	// only dirty pages are written
+}	// END OF 'tracklog_sync'
+
+void tracklog_close(tracklog& log) {
+	if (log.map == NULL) return;
+	munmap(log.map, log.map_len);
+	close(log.fd);
+	log.map = NULL;
+}	// END OF 'tracklog_close'
@@ -0,0 +1,75 @@
+// Track log: every fix and beacon in a memory mapped ring file that survives a crash.
+
+#ifndef __TRACKLOG_H__
+#define __TRACKLOG_H__
+
+#include <atomic>
+#include "fix.h"
+
+#define TRACKLOG_MAGIC 0x474C4B54	// "TKLG", little endian
+#define TRACKLOG_VERSION 1
+#define TRACKLOG_HEADER_SIZE 64	// records start here
+
+enum track_type {
+	TRACK_FIX = 1,				// a valid fix from the receiver
+	TRACK_BEACON				// a position we sent, 'format' says how
+};
+
+struct tracklog_header {		// at the start of the file, written once when it's created
+	unsigned int magic;
+	unsigned int version;
+	unsigned int record_size;
+	unsigned int capacity;		// records in the ring
+};
+
+// 32 bytes, so a record never straddles a sector or a page. A record is
+// only trusted if its CRC (the AX.25 FCS, over everything before it) checks
+// out, so one torn by a power cut is skipped rather than misread. The ring
+// position of a record is its sequence number modulo the capacity.
+struct tracklog_record {
+	unsigned long long seq;		// from 1, 0 for a slot never written
+	long long time;				// UTC of the fix, ms since the epoch
+	int lat;					// micro-degrees, negative for S
+	int lon;					// micro-degrees, negative for W
+	unsigned short speed;		// hundredths of a knot
+	unsigned short course;		// degrees
+	unsigned char type;			// track_type
+	unsigned char format;		// aprs_format of a beacon
+	unsigned short crc;
+};
+
+// Appending is a copy into the mapping: no system calls, and the kernel
+// writes the pages back on its own. tracklog_sync() bounds how much a power
+// cut can take. Several threads may append at once, each gets its own
+// sequence number and slot.
+struct tracklog {
+	int fd;
+	unsigned char* map;
+	long long map_len;
+	tracklog_header* header;
+	tracklog_record* records;
+	std::atomic<unsigned long long> next_seq;
+	unsigned long long first_seq;	// oldest record found at open
+	unsigned long recovered;	// good records found at open
+	unsigned long torn;			// slots with a bad CRC at open
+};
+
+// Open or create the ring file at 'path' with room for 'capacity' records.
+// An existing log keeps its own capacity. The ring is scanned for the
+// newest good record and appending carries on after it. 'writable' false
+// opens it read only for dumping. Returns false with errno set on failure.
+bool tracklog_open(tracklog& log, const char* path, int capacity, bool writable);
+
+// Log a fix, or a beacon sent from it in 'format'.
+void tracklog_append(tracklog& log, track_type type, const gps_fix& fix, int format);
+
+// Copy record 'seq' into 'record'. Returns false if it has been overwritten
+// or never made it to the file.
+bool tracklog_get(const tracklog& log, unsigned long long seq, tracklog_record& record);
+
+// Force what has been appended so far out to the file.
+void tracklog_sync(tracklog& log);
+
+void tracklog_close(tracklog& log);
+
+#endif  // __TRACKLOG_H__
@@ -0,0 +1,92 @@
+// Priority transmit queue with an airtime budget.
+
+#include "ax25.h"
+#include "txq.h"
+
+void txq_init(tx_queue& queue, int radio_baud, int percent, int window, long long now) {
+	queue.slots = new tx_frame[TX_CLASSES * TXQ_SLOTS];
+	for (int c=0;c<TX_CLASSES;c++) {
+		queue.head[c] = 0;
+		queue.len[c] = 0;
+		queue.sent[c] = 0;
+		queue.dropped[c] = 0;
+	}
+	queue.radio_baud = radio_baud;
+	queue.window = window * 1000LL;
+	queue.budget = percent >= 100 ? 0 : queue.window * percent / 100;	// 0: no budget
+	queue.credit = queue.budget * queue.window;		// start with a full bucket
+	queue.refilled = now;
+}	// END OF 'txq_init'
+
+static tx_frame& slot(tx_queue& queue, int cls, int i) {		// i-th frame of a class, 0 is the oldest
+	return queue.slots[cls * TXQ_SLOTS + (queue.head[cls] + i) % TXQ_SLOTS];
+}
+
+static void drop_oldest(tx_queue& queue, int cls) {
+	queue.head[cls] = (queue.head[cls] + 1) % TXQ_SLOTS;
+	queue.len[cls]--;
+	queue.dropped[cls]++;
+}
+
+static void drop_stale(tx_queue& queue, long long now) {
+	for (int c=0;c<TX_CLASSES;c++) {
+		while (queue.len[c] > 0 && now - slot(queue, c, 0).queued > TXQ_MAX_AGE) drop_oldest(queue, c);
+	}
+}
+
+static void refill(tx_queue& queue, long long now) {
+	if (queue.budget == 0 || now <= queue.refilled) return;
+	queue.credit += (now - queue.refilled) * queue.budget;
+	if (queue.credit > queue.budget * queue.window) queue.credit = queue.budget * queue.window;
+	queue.refilled = now;
+}
+
+unsigned char* txq_reserve(tx_queue& queue, int cls) {
+	if (queue.len[cls] == TXQ_SLOTS) drop_oldest(queue, cls);	// newer news wins
+	return slot(queue, cls, queue.len[cls]).data;
+}	// END OF 'txq_reserve'
+
+void txq_commit(tx_queue& queue, int cls, int len, long long now) {
+	tx_frame& frame = slot(queue, cls, queue.len[cls]);
+	int escapes = 0;
+	for (int i=0;i<len;i++) {
+		if (frame.data[i] == KISS_FESC) escapes++;
+	}
+	frame.len = len;
+	frame.airtime = ax25_airtime_ms(len - 3 - escapes, queue.radio_baud);	// less FEND, command, FEND and escapes
+	frame.queued = now;
+	queue.len[cls]++;
+}	// END OF 'txq_commit'
+
+int txq_collect(tx_queue& queue, long long now, struct iovec* iov, int max, int& airtime) {
+	drop_stale(queue, now);
+	refill(queue, now);
+	int count = 0;
+	airtime = 0;
+	for (int c=0;c<TX_CLASSES && count<max;c++) {
+		while (queue.len[c] > 0 && count < max && (queue.budget == 0 || queue.credit > 0)) {
+			tx_frame& frame = slot(queue, c, 0);
+			iov[count].iov_base = frame.data;
+			iov[count].iov_len = frame.len;
+			count++;
+			airtime += frame.airtime;
+			queue.credit -= frame.airtime * queue.window;
+			queue.head[c] = (queue.head[c] + 1) % TXQ_SLOTS;	// the slot isn't reused until the next reserve
+			queue.len[c]--;
+			queue.sent[c]++;
+		}
+	}
+	return count;
+}	// END OF 'txq_collect'
+
+long long txq_next(tx_queue& queue, long long now) {
+	drop_stale(queue, now);
+	bool waiting = false;
+	for (int c=0;c<TX_CLASSES;c++) {
+		if (queue.len[c] > 0) waiting = true;
+	}
+	if (!waiting) return -1;
+	refill(queue, now);
+	if (queue.budget == 0 || queue.credit > 0) return now;
+	return now + -queue.credit / queue.budget + 1;		// when the debt is paid off
+}	// END OF 'txq_next'
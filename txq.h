@@ -0,0 +1,69 @@
+// Priority transmit queue with an airtime budget.
+
+#ifndef __TXQ_H__
+#define __TXQ_H__
+
+#include <sys/uio.h>
+#include "ax25.h"
+
+#define TXQ_SLOTS 16			// frames held per class, the oldest is dropped to make room
+#define TXQ_MAX_AGE 30000		// ms, a frame still waiting after this is stale and dropped
+#define TXQ_BATCH 16			// most frames handed to the TNC in one go
+
+enum tx_class {					// highest priority first
+	TX_DIGI,					// digipeated frames, late is as good as never
+	TX_BEACON,					// our own position
+	TX_OBJECT,					// objects and items
+	TX_CLIENT,					// from local KISS clients
+	TX_TELEMETRY,
+	TX_CLASSES
+};
+
+struct tx_frame {
+	unsigned char data[KISS_MAX_FRAME];	// KISS encoded, ready for the port
+	int len;
+	int airtime;				// ms on the air at the radio baud rate
+	long long queued;			// when it went in, monotonic ms
+};
+
+// Frames are KISS encoded straight into fixed slots, a ring per class, so
+// queueing never allocates. txq_collect() hands out whatever is ready, best
+// class first, as one batch for a single writev(). Airtime is metered with a
+// token bucket: the channel gets 'budget' ms of our transmissions per
+// 'window' ms, and a full bucket allows a burst of that much. A frame goes
+// while there is any credit left, the bucket going into debt for it.
+struct tx_queue {
+	tx_frame* slots;			// TX_CLASSES * TXQ_SLOTS
+	int head[TX_CLASSES];
+	int len[TX_CLASSES];
+	int radio_baud;				// on-air bit rate, not the serial rate
+	long long budget;			// ms of airtime per window
+	long long window;			// ms
+	long long credit;			// airtime left, in ms * window so refills are exact
+	long long refilled;			// when credit was last topped up
+	unsigned long sent[TX_CLASSES];
+	unsigned long dropped[TX_CLASSES];	// pushed out by newer frames or gone stale
+};
+
+// Set up a queue for a radio at 'radio_baud', allowed 'percent' of the
+// channel averaged over 'window' seconds. 100 percent turns the budget off.
+void txq_init(tx_queue& queue, int radio_baud, int percent, int window, long long now);
+
+// Get a slot at the back of class 'cls' to encode a frame into (at least
+// KISS_MAX_FRAME bytes), dropping the oldest frame of that class if it is
+// full. Nothing is queued until txq_commit().
+unsigned char* txq_reserve(tx_queue& queue, int cls);
+
+// Queue the frame written to the last reserved slot of 'cls'.
+void txq_commit(tx_queue& queue, int cls, int len, long long now);
+
+// Take the frames that may go now, best class first, up to 'max' of them,
+// and point 'iov' at them. They stay valid until the next txq_reserve().
+// Returns how many there are, and their total airtime in 'airtime'.
+int txq_collect(tx_queue& queue, long long now, struct iovec* iov, int max, int& airtime);
+
+// When the next frame may go: 'now' if one is ready, later if the budget is
+// spent, or -1 if nothing is queued.
+long long txq_next(tx_queue& queue, long long now);
+
+#endif  // __TXQ_H__
@@ -0,0 +1,91 @@
+// Warm start: the last good fix kept in a small memory mapped file across restarts.
+
+#include <cstddef>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "hdlc.h"
+#include "warmstart.h"
+
+static unsigned short slot_crc(const warmstart_record& record) {
+	return hdlc_fcs((const unsigned char*)&record, offsetof(warmstart_record, crc));
+}
+
+static const warmstart_record* newest(const warmstart& state) {	// the good slot with the higher seq, or NULL
+	const warmstart_record* best = NULL;
+	for (int i=0;i<2;i++) {
+		const warmstart_record& slot = state.slots[i];
+		if (slot.magic != WARMSTART_MAGIC || slot_crc(slot) != slot.crc) continue;
+		if (best == NULL || (int)(slot.seq - best->seq) > 0) best = &slot;
+	}
+	return best;
+}
+
+bool warmstart_open(warmstart& state, const char* path) {
+	state.fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (state.fd == -1) return false;
+	if (ftruncate(state.fd, 2 * sizeof(warmstart_record)) == -1) {	// a new file reads as two empty slots
+		close(state.fd);
+		return false;
+	}
+	void* map = mmap(NULL, 2 * sizeof(warmstart_record), PROT_READ | PROT_WRITE, MAP_SHARED, state.fd, 0);
+	if (map == MAP_FAILED) {
+		close(state.fd);
+		return false;
+	}
+	state.slots = (warmstart_record*)map;
+	const warmstart_record* last = newest(state);
+	state.seq = last != NULL ? last->seq : 0;
+	return true;
+}	// END OF 'warmstart_open'
+
+bool warmstart_load(const warmstart& state, int max_age, gps_fix& fix) {
+	const warmstart_record* last = newest(state);
+	if (last == NULL) return false;
+	gps_fix saved = gps_fix();
+	time_t seconds = last->time / 1000;
+	gmtime_r(&seconds, &saved.time);
+	saved.valid = true;
+	saved.warm = true;
+	saved.lat = last->lat;
+	saved.lon = last->lon;
+	saved.speed = 0;							// parked, as far as anyone knows
+	saved.hdg = last->hdg;
+	long age = fix_age(saved);
+	if (age < 0 || age > max_age) return false;
+	fix = saved;
+	return true;
+}	// END OF 'warmstart_load'
+
+void warmstart_save(warmstart& state, const gps_fix& fix) {
+	warmstart_record record;
+	memset(&record, 0, sizeof(record));
+	record.magic = WARMSTART_MAGIC;
+	record.seq = ++state.seq;
+	struct tm time = fix.time;
+	record.time = timegm(&time) * 1000LL;
+	record.lat = fix.lat;
+	record.lon = fix.lon;
+	record.speed = fix.speed;
+	record.hdg = fix.hdg;
+	record.crc = slot_crc(record);
+	msync(state.slots, 2 * sizeof(warmstart_record), MS_SYNC);		// the last save is on disk before we touch the other slot
+	memcpy(&state.slots[record.seq & 1], &record, sizeof(record));	// never the slot holding the last save
+}	// END OF 'warmstart_save'
+
+long fix_age(const gps_fix& fix) {
+	struct tm time = fix.time;
+	long age = ::time(NULL) - timegm(&time);
+	return age < 0 ? -1 : age;
+}	// END OF 'fix_age'
+
+void warmstart_close(warmstart& state) {
+	if (state.slots == NULL) return;
+	msync(state.slots, 2 * sizeof(warmstart_record), MS_SYNC);
+	munmap(state.slots, 2 * sizeof(warmstart_record));
+	close(state.fd);
+	state.slots = NULL;
+}	// END OF 'warmstart_close'
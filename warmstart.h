@@ -0,0 +1,49 @@
+// Warm start: the last good fix kept in a small memory mapped file across restarts.
+
+#ifndef __WARMSTART_H__
+#define __WARMSTART_H__
+
+#include "fix.h"
+
+#define WARMSTART_MAGIC 0x4D524157	// "WARM", little endian
+
+struct warmstart_record {		// one of two slots in the file
+	unsigned int magic;
+	unsigned int seq;			// the newer slot wins
+	long long time;				// UTC of the fix, ms since the epoch
+	int lat;					// micro-degrees
+	int lon;
+	int speed;					// hundredths of a knot
+	int hdg;
+	unsigned short crc;			// AX.25 FCS of everything before it
+	unsigned short unused;
+};
+
+// Saves go to alternate slots, so if the power goes halfway through one the
+// other still holds the fix before it. Saving syncs the last save to disk
+// and copies the new one into the mapping, which the next save or
+// warmstart_close() syncs in turn; loading is one open() and mmap().
+struct warmstart {
+	int fd;
+	warmstart_record* slots;	// 2, mapped
+	unsigned int seq;
+};
+
+// Map the state file at 'path', creating it if needed. Returns false with
+// errno set on failure.
+bool warmstart_open(warmstart& state, const char* path);
+
+// The saved fix, if there is one and it is at most 'max_age' seconds old by
+// the system clock. It comes back valid and marked warm, with no speed.
+bool warmstart_load(const warmstart& state, int max_age, gps_fix& fix);
+
+// Save a valid fix from the receiver.
+void warmstart_save(warmstart& state, const gps_fix& fix);
+
+// Seconds since a fix was taken, by the system clock, or -1 if it is from
+// the future (no RTC and no NTP yet).
+long fix_age(const gps_fix& fix);
+
+void warmstart_close(warmstart& state);
+
+#endif  // __WARMSTART_H__
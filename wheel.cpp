@@ -0,0 +1,94 @@
+// Hierarchical timing wheel for scheduling lots of periodic jobs.
+
+#include "wheel.h"
+
+static void unlink(timing_wheel& wheel, int id) {
+	int list = wheel.list[id];
+	if (list == -1) return;
+	if (wheel.prev[id] == -1) wheel.heads[list] = wheel.next[id];
+	else wheel.next[wheel.prev[id]] = wheel.next[id];
+	if (wheel.next[id] != -1) wheel.prev[wheel.next[id]] = wheel.prev[id];
+	wheel.list[id] = -1;
+}
+
+static void link(timing_wheel& wheel, int id, int list) {
+	wheel.prev[id] = -1;
+	wheel.next[id] = wheel.heads[list];
+	if (wheel.heads[list] != -1) wheel.prev[wheel.heads[list]] = id;
+	wheel.heads[list] = id;
+	wheel.list[id] = list;
+}
+
+static void place(timing_wheel& wheel, int id) {		// put an entry on the right list for its expiry
+	unsigned long expires = wheel.expires[id];
+	if (expires <= wheel.now) {
+		link(wheel, id, WHEEL_EXPIRED);
+		return;
+	}
+	unsigned long delta = expires - wheel.now;
+	int level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >= 1UL << (WHEEL_BITS * (level + 1))) level++;
+	if (delta >= 1UL << (WHEEL_BITS * WHEEL_LEVELS)) {	// too far out, park it as far as we can and re-place it then
+		expires = wheel.now + (1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+	}
+	int slot = (expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+	link(wheel, id, level * WHEEL_SLOTS + slot);
+}
+
+static void cascade(timing_wheel& wheel, int level) {	// spread one higher level slot over the levels below it
+	int list = level * WHEEL_SLOTS + ((wheel.now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+	int id = wheel.heads[list];
+	wheel.heads[list] = -1;
+	while (id != -1) {
+		int next = wheel.next[id];
+		wheel.list[id] = -1;
+		place(wheel, id);
+		id = next;
+	}
+}
+
+void wheel_init(timing_wheel& wheel, int capacity, unsigned long now) {
+	wheel.now = now;
+	wheel.capacity = capacity;
+	for (int i=0;i<=WHEEL_EXPIRED;i++) wheel.heads[i] = -1;
+	wheel.next = new int[capacity];
+	wheel.prev = new int[capacity];
+	wheel.list = new int[capacity];
+	wheel.expires = new unsigned long[capacity];
+	for (int i=0;i<capacity;i++) wheel.list[i] = -1;
+}	// END OF 'wheel_init'
+
+void wheel_schedule(timing_wheel& wheel, int id, unsigned long expires) {
+	unlink(wheel, id);
+	wheel.expires[id] = expires;
+	place(wheel, id);
+}	// END OF 'wheel_schedule'
+
+void wheel_cancel(timing_wheel& wheel, int id) {
+	unlink(wheel, id);
+}	// END OF 'wheel_cancel'
+
+void wheel_advance(timing_wheel& wheel, unsigned long tick) {
+	while (wheel.now < tick) {
+		wheel.now++;
+		for (int level=1; level<WHEEL_LEVELS; level++) {	// a lower level wrapped, pull the next bucket down
+			if (wheel.now & ((1UL << (WHEEL_BITS * level)) - 1)) break;
+			cascade(wheel, level);
+		}
+		int list = wheel.now & (WHEEL_SLOTS - 1);
+		int id = wheel.heads[list];
+		wheel.heads[list] = -1;
+		while (id != -1) {				// everything in this slot is due now, or was parked and needs re-placing
+			int next = wheel.next[id];
+			wheel.list[id] = -1;
+			place(wheel, id);
+			id = next;
+		}
+	}
+}	// END OF 'wheel_advance'
+
+int wheel_pop(timing_wheel& wheel) {
+	int id = wheel.heads[WHEEL_EXPIRED];
+	if (id != -1) unlink(wheel, id);
+	return id;
+}	// END OF 'wheel_pop'
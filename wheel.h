@@ -0,0 +1,42 @@
+// Hierarchical timing wheel for scheduling lots of periodic jobs.
+
+#ifndef __WHEEL_H__
+#define __WHEEL_H__
+
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)	// slots per level
+#define WHEEL_LEVELS 3					// 2^24 ticks before anything has to be clamped
+#define WHEEL_EXPIRED (WHEEL_LEVELS * WHEEL_SLOTS)	// list index of the expired list
+
+// Entries are identified by an index below 'capacity' and kept in intrusive
+// doubly linked lists, one per slot, so scheduling, cancelling and expiring
+// an entry are all O(1) no matter how many there are. Level 0 holds entries
+// due in the next WHEEL_SLOTS ticks; higher levels hold coarser buckets that
+// are cascaded down as the wheel turns. All memory is allocated by
+// wheel_init().
+struct timing_wheel {
+	unsigned long now;					// current tick
+	int heads[WHEEL_EXPIRED + 1];		// first entry of each slot's list, and of the expired list; -1 if empty
+	int capacity;
+	int* next;
+	int* prev;
+	int* list;							// which list each entry is on, -1 if not scheduled
+	unsigned long* expires;				// tick each entry is due
+};
+
+void wheel_init(timing_wheel& wheel, int capacity, unsigned long now);
+
+// Schedule entry 'id' to expire at tick 'expires', replacing any earlier
+// schedule. A tick that has already passed expires on the next advance.
+void wheel_schedule(timing_wheel& wheel, int id, unsigned long expires);
+
+void wheel_cancel(timing_wheel& wheel, int id);
+
+// Turn the wheel forward to 'tick', moving everything that came due onto the
+// expired list.
+void wheel_advance(timing_wheel& wheel, unsigned long tick);
+
+// Take the next entry off the expired list, or -1 if there are none.
+int wheel_pop(timing_wheel& wheel);
+
+#endif  // __WHEEL_H__